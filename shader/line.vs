@@ -3,8 +3,18 @@ layout (location = 0) in vec3 vPos;
 
 out vec4 fragPos;
 
-uniform mat4 viewProj;
-uniform mat4 model;
+// Matches FrameConstants in frameconstants.h.
+layout(std140, binding = 0) uniform FrameConstants
+{
+  mat4 viewProj;
+  vec4 viewPos;
+};
+
+// Matches DrawConstants in frameconstants.h.
+layout(std140, binding = 1) uniform DrawConstants
+{
+  mat4 model;
+};
 
 void main()
 {
@@ -0,0 +1,183 @@
+#ifndef BARYCENTRICS
+#define BARYCENTRICS 0
+#endif // BARYCENTRICS
+
+// Barycentrics for the wireframe overlay: 1 interpolated from the previous stage,
+// 2 GL_NV_fragment_shader_barycentric, 3 GL_AMD_shader_explicit_vertex_parameter.
+#if BARYCENTRICS == 2
+#extension GL_NV_fragment_shader_barycentric : require
+#elif BARYCENTRICS == 3
+#extension GL_AMD_shader_explicit_vertex_parameter : require
+#endif // BARYCENTRICS
+
+#ifndef DIFFUSE_TEXTURE
+#define DIFFUSE_TEXTURE 0
+#endif // DIFFUSE_TEXTURE
+
+in vec4 fragPos;
+in vec3 fragNormal;
+in vec4 fragTangent;
+in vec2 texCoord;
+
+out vec4 FragColor;
+
+// Matches FrameConstants in frameconstants.h.
+layout(std140, binding = 0) uniform FrameConstants
+{
+  mat4 viewProj;
+  vec4 viewPos;
+};
+
+// Height and its uv derivatives, as baked for the tessellation path.
+uniform sampler2D displacement;
+uniform int parallaxSteps;
+
+#if DIFFUSE_TEXTURE
+uniform sampler2D tex;
+#endif // DIFFUSE_TEXTURE
+
+#if BARYCENTRICS
+#if BARYCENTRICS == 1
+noperspective in vec3 fragBarycentric;
+#endif // BARYCENTRICS == 1
+
+uniform int wireframe;
+
+vec3 barycentrics()
+{
+#if BARYCENTRICS == 2
+  return gl_BaryCoordNoPerspNV;
+#elif BARYCENTRICS == 3
+  return vec3(gl_BaryCoordNoPerspAMD, 1.0 - gl_BaryCoordNoPerspAMD.x - gl_BaryCoordNoPerspAMD.y);
+#else // BARYCENTRICS == 1
+  return fragBarycentric;
+#endif // BARYCENTRICS == 1
+}
+
+// Coverage of the closest triangle edge, about a pixel wide at any distance.
+float wireframeCoverage()
+{
+  vec3 bary = barycentrics();
+  vec3 edge = smoothstep(vec3(0.0), fwidth(bary) * 1.5, bary);
+  return 1.0 - min(min(edge.x, edge.y), edge.z);
+}
+#endif // BARYCENTRICS
+
+// Same scale as subdiv.tev, so both techniques displace by the same amount.
+const float heightStrength = 0.05;
+
+// The drawn surface is the top of the height field, depth runs into the surface in uv units.
+float sampleDepth(vec2 uv, vec2 dx, vec2 dy)
+{
+  return 1.0 - textureGrad(displacement, uv, dx, dy).r;
+}
+
+// Steps along the view ray through the height field and refines the hit between the last
+// two steps. Returns the uv of the hit and its depth in [0, 1].
+vec2 parallaxOcclusion(vec2 uv, vec3 viewTS, vec2 dx, vec2 dy, out float hitDepth)
+{
+  // Grazing angles cross more texels, they get more steps.
+  float numSteps = mix(float(parallaxSteps), float(parallaxSteps) * 0.25, abs(viewTS.z));
+  float stepDepth = 1.0 / numSteps;
+  vec2 stepUV = -viewTS.xy / max(viewTS.z, 0.05) * heightStrength * stepDepth;
+
+  float rayDepth = 0.0;
+  float surfaceDepth = sampleDepth(uv, dx, dy);
+  float prevRayDepth = 0.0;
+  float prevSurfaceDepth = surfaceDepth;
+  for (int i = 0; i < parallaxSteps && rayDepth < surfaceDepth; i++)
+  {
+    prevRayDepth = rayDepth;
+    prevSurfaceDepth = surfaceDepth;
+
+    uv += stepUV;
+    rayDepth += stepDepth;
+    surfaceDepth = sampleDepth(uv, dx, dy);
+  }
+
+  // Intersect the ray with the surface linearly between the last two samples.
+  float after = surfaceDepth - rayDepth;
+  float before = prevSurfaceDepth - prevRayDepth;
+  float weight = after / (after - before + 1e-5);
+  hitDepth = mix(rayDepth, prevRayDepth, weight);
+  return uv - stepUV * weight;
+}
+
+// Marches from the hit towards the light, 1 when unoccluded. Occluders closer to the hit
+// and rising further above the ray shadow more, which softens the edge.
+float parallaxShadow(vec2 uv, float depth, vec3 lightTS, vec2 dx, vec2 dy)
+{
+  if (lightTS.z <= 0.0)
+    return 0.0;
+
+  int numSteps = max(parallaxSteps / 2, 1);
+  float stepDepth = depth / float(numSteps);
+  vec2 stepUV = lightTS.xy / max(lightTS.z, 0.05) * heightStrength * stepDepth;
+
+  float occlusion = 0.0;
+  float rayDepth = depth;
+  for (int i = 1; i <= numSteps && rayDepth > 0.0; i++)
+  {
+    uv += stepUV;
+    rayDepth -= stepDepth;
+    float above = rayDepth - sampleDepth(uv, dx, dy);
+    occlusion = max(occlusion, above * (1.0 - float(i) / float(numSteps)));
+  }
+
+  return 1.0 - clamp(occlusion * 8.0, 0.0, 1.0);
+}
+
+void main()
+{
+  vec3 lightColor = vec3(0.8, 0.8, 0.8);
+  vec3 lightPos = vec3(3, 3, 3);
+  vec3 objectColor = vec3(0.2, 0.2, 1.0);
+
+  float ambientStrength = 0.3;
+  float specularStrength = 0.8;
+  float specPower = 32.0;
+
+  vec3 normal = normalize(fragNormal);
+  vec3 tangent = normalize(fragTangent.xyz - normal * dot(normal, fragTangent.xyz));
+  vec3 bitangent = cross(normal, tangent) * fragTangent.w;
+  mat3 TBN = mat3(tangent, bitangent, normal);
+
+  vec3 vecToLight = normalize(lightPos - fragPos.xyz);
+  vec3 vecToView = normalize(viewPos.xyz - fragPos.xyz);
+  vec3 viewTS = transpose(TBN) * vecToView;
+  vec3 lightTS = transpose(TBN) * vecToLight;
+
+  // The marched uvs jump between steps, take the gradients of the smooth ones.
+  vec2 dx = dFdx(texCoord);
+  vec2 dy = dFdy(texCoord);
+
+  float hitDepth;
+  vec2 uv = parallaxOcclusion(texCoord, viewTS, dx, dy, hitDepth);
+  float shadow = parallaxShadow(uv, hitDepth, lightTS, dx, dy);
+
+  // Normal from the baked derivatives, the same way subdiv.tev perturbs it.
+  vec2 derivatives = textureGrad(displacement, uv, dx, dy).gb * heightStrength;
+  normal = normalize(TBN * vec3(-derivatives, 1.0));
+
+  vec3 ambient = ambientStrength * lightColor;
+
+  float diff = max(dot(normal, vecToLight), 0.0);
+  vec3 diffuse = diff * lightColor;
+
+  vec3 reflectDir = reflect(-vecToLight, normal);
+  float spec = pow(max(dot(vecToView, reflectDir), 0.0), specPower);
+  vec3 specular = specularStrength * spec * lightColor;
+
+#if DIFFUSE_TEXTURE
+  objectColor = textureGrad(tex, uv, dx, dy).rgb;
+#endif // DIFFUSE_TEXTURE
+
+  vec3 result = (ambient + shadow * (diffuse + specular)) * objectColor;
+
+#if BARYCENTRICS
+  if (wireframe != 0)
+    result = mix(result, vec3(0.02, 0.02, 0.02), wireframeCoverage());
+#endif // BARYCENTRICS
+
+  FragColor = vec4(result, 1);
+}
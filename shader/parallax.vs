@@ -0,0 +1,86 @@
+#ifndef COMPACT_VERTEX_FORMAT
+#define COMPACT_VERTEX_FORMAT 0
+#endif // COMPACT_VERTEX_FORMAT
+
+#ifndef QUANTIZED_POSITIONS
+#define QUANTIZED_POSITIONS 0
+#endif // QUANTIZED_POSITIONS
+
+#ifndef WIREFRAME_GEOMETRY
+#define WIREFRAME_GEOMETRY 0
+#endif // WIREFRAME_GEOMETRY
+
+#if WIREFRAME_GEOMETRY
+// wireframe.gs sits between this stage and the fragment shader and forwards these under
+// their usual names.
+#define fragPos geom_fragPos
+#define fragNormal geom_fragNormal
+#define fragTangent geom_fragTangent
+#define texCoord geom_texCoord
+#endif // WIREFRAME_GEOMETRY
+
+#if COMPACT_VERTEX_FORMAT
+// Static mesh layout from MeshPart: octahedral snorm16 normal and tangent, with the
+// bitangent sign in the lowest bit of the last component.
+layout (location = 0) in vec3 vPackedPos;
+layout (location = 1) in ivec4 vFrame;
+layout (location = 3) in vec2 vUV;
+
+#if QUANTIZED_POSITIONS
+layout (location = 4) in vec3 vPositionScale;
+layout (location = 5) in vec3 vPositionOffset;
+#endif // QUANTIZED_POSITIONS
+
+vec3 octDecode(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+#else // !COMPACT_VERTEX_FORMAT
+layout (location = 0) in vec3 vPos;
+layout (location = 1) in vec3 vNormal;
+layout (location = 2) in vec4 vTangent;
+layout (location = 3) in vec2 vUV;
+#endif // !COMPACT_VERTEX_FORMAT
+
+out vec4 fragPos;
+out vec3 fragNormal;
+out vec4 fragTangent;
+out vec2 texCoord;
+
+// Matches FrameConstants in frameconstants.h.
+layout(std140, binding = 0) uniform FrameConstants
+{
+  mat4 viewProj;
+  vec4 viewPos;
+};
+
+// Matches DrawConstants in frameconstants.h.
+layout(std140, binding = 1) uniform DrawConstants
+{
+  mat4 model;
+};
+
+void main()
+{
+#if COMPACT_VERTEX_FORMAT
+#if QUANTIZED_POSITIONS
+  vec3 vPos = vPositionOffset + vPackedPos * vPositionScale;
+#else // !QUANTIZED_POSITIONS
+  vec3 vPos = vPackedPos;
+#endif // !QUANTIZED_POSITIONS
+  vec4 frame = clamp(vec4(vFrame) / 32767.0, -1.0, 1.0);
+  vec3 vNormal = octDecode(frame.xy);
+  vec4 vTangent = vec4(octDecode(frame.zw), (vFrame.w & 1) != 0 ? -1.0 : 1.0);
+#endif // COMPACT_VERTEX_FORMAT
+
+  // TODO transform by model
+  fragPos = vec4(vPos, 1.0);
+  fragNormal = vNormal;
+  fragTangent = vTangent;
+  texCoord = vUV;
+
+  gl_Position = viewProj * model * fragPos;
+}
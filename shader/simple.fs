@@ -1,13 +1,57 @@
 
+#ifndef BARYCENTRICS
+#define BARYCENTRICS 0
+#endif // BARYCENTRICS
+
+// Barycentrics for the wireframe overlay: 1 interpolated from the previous stage,
+// 2 GL_NV_fragment_shader_barycentric, 3 GL_AMD_shader_explicit_vertex_parameter.
+#if BARYCENTRICS == 2
+#extension GL_NV_fragment_shader_barycentric : require
+#elif BARYCENTRICS == 3
+#extension GL_AMD_shader_explicit_vertex_parameter : require
+#endif // BARYCENTRICS
+
 in vec4 fragPos;
 in vec3 fragNormal;
 in vec2 texCoord;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
+// Matches FrameConstants in frameconstants.h.
+layout(std140, binding = 0) uniform FrameConstants
+{
+  mat4 viewProj;
+  vec4 viewPos;
+};
 uniform sampler2D displacement;
 
+#if BARYCENTRICS
+#if BARYCENTRICS == 1
+noperspective in vec3 fragBarycentric;
+#endif // BARYCENTRICS == 1
+
+uniform int wireframe;
+
+vec3 barycentrics()
+{
+#if BARYCENTRICS == 2
+  return gl_BaryCoordNoPerspNV;
+#elif BARYCENTRICS == 3
+  return vec3(gl_BaryCoordNoPerspAMD, 1.0 - gl_BaryCoordNoPerspAMD.x - gl_BaryCoordNoPerspAMD.y);
+#else // BARYCENTRICS == 1
+  return fragBarycentric;
+#endif // BARYCENTRICS == 1
+}
+
+// Coverage of the closest triangle edge, about a pixel wide at any distance.
+float wireframeCoverage()
+{
+  vec3 bary = barycentrics();
+  vec3 edge = smoothstep(vec3(0.0), fwidth(bary) * 1.5, bary);
+  return 1.0 - min(min(edge.x, edge.y), edge.z);
+}
+#endif // BARYCENTRICS
+
 void main()
 {
   vec3 lightColor = vec3(0.8, 0.8, 0.8);
@@ -19,7 +63,7 @@ void main()
   float specPower = 32.0;
 
   vec3 vecToLight = normalize(lightPos - fragPos.xyz);
-  vec3 vecToView = normalize(viewPos - fragPos.xyz);
+  vec3 vecToView = normalize(viewPos.xyz - fragPos.xyz);
 
   vec3 ambient = ambientStrength * lightColor;
 
@@ -34,6 +78,11 @@ void main()
   
   vec3 result = (ambient + diffuse + specular) * objectColor;
 
+#if BARYCENTRICS
+  if (wireframe != 0)
+    result = mix(result, vec3(0.02, 0.02, 0.02), wireframeCoverage());
+#endif // BARYCENTRICS
+
   FragColor = vec4(result, 1);
   // FragColor = vec4(fragNormal, 1);
 }
\ No newline at end of file
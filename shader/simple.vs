@@ -1,24 +1,133 @@
 
+#ifndef COMPACT_VERTEX_FORMAT
+#define COMPACT_VERTEX_FORMAT 0
+#endif // COMPACT_VERTEX_FORMAT
+
+#ifndef QUANTIZED_POSITIONS
+#define QUANTIZED_POSITIONS 0
+#endif // QUANTIZED_POSITIONS
+
+#ifndef MATERIAL_ARRAYS
+#define MATERIAL_ARRAYS 0
+#endif // MATERIAL_ARRAYS
+
+#ifndef VERTEX_PULLING
+#define VERTEX_PULLING 0
+#endif // VERTEX_PULLING
+
+#ifndef WIREFRAME_GEOMETRY
+#define WIREFRAME_GEOMETRY 0
+#endif // WIREFRAME_GEOMETRY
+
+#if WIREFRAME_GEOMETRY
+// wireframe.gs sits between this stage and the fragment shader and forwards these under
+// their usual names.
+#define fragPos geom_fragPos
+#define fragNormal geom_fragNormal
+#define texCoord geom_texCoord
+#define materialIndex geom_materialIndex
+#endif // WIREFRAME_GEOMETRY
+
+#if VERTEX_PULLING
+// GPUMeshStreams as written by tilegen.glsl, read by vertex id instead of through the VAO.
+// GENERATED_VERTEX_BINDING and GENERATED_INDEX_BINDING come from main.cpp.
+struct GeneratedVertex
+{
+  vec3 position;
+  vec3 normal;
+  vec2 uv;
+};
+
+layout(std430, binding = GENERATED_VERTEX_BINDING) readonly buffer generatedVertexStream
+{
+  uint numVertices;
+  GeneratedVertex generatedVertices[];
+};
+
+layout(std430, binding = GENERATED_INDEX_BINDING) readonly buffer generatedIndexStream
+{
+  uint numIndices;
+  uint generatedIndices[];
+};
+
+// Every triangle corner is its own vertex, so each can carry its own barycentric.
+noperspective out vec3 fragBarycentric;
+#elif COMPACT_VERTEX_FORMAT
+// Static mesh layout from MeshPart: octahedral snorm16 normal and tangent, with the
+// bitangent sign in the lowest bit of the last component.
+layout (location = 0) in vec3 vPackedPos;
+layout (location = 1) in ivec4 vFrame;
+layout (location = 3) in vec2 vUV;
+
+#if QUANTIZED_POSITIONS
+layout (location = 4) in vec3 vPositionScale;
+layout (location = 5) in vec3 vPositionOffset;
+#endif // QUANTIZED_POSITIONS
+
+vec3 octDecode(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+#else // !VERTEX_PULLING && !COMPACT_VERTEX_FORMAT
 layout (location = 0) in vec3 vPos;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec3 vTangent;
 layout (location = 3) in vec2 vUV;
+#endif // !VERTEX_PULLING && !COMPACT_VERTEX_FORMAT
 
 out vec4 fragPos;
 out vec3 fragNormal;
 out vec2 texCoord;
 
-uniform mat4 viewProj;
-uniform mat4 model;
+#if MATERIAL_ARRAYS
+// Batched meshes issue one indirect command per part, the draw id selects its material.
+flat out int materialIndex;
+#endif // MATERIAL_ARRAYS
+
+// Matches FrameConstants in frameconstants.h.
+layout(std140, binding = 0) uniform FrameConstants
+{
+  mat4 viewProj;
+  vec4 viewPos;
+};
+
+// Matches DrawConstants in frameconstants.h.
+layout(std140, binding = 1) uniform DrawConstants
+{
+  mat4 model;
+};
 
 // uniform sampler2D displacement;
 
 void main()
 {
+#if VERTEX_PULLING
+  // The draw starts at vertex 1, the indices follow their counter.
+  uint corner = uint(gl_VertexID - 1);
+  GeneratedVertex generated = generatedVertices[generatedIndices[corner]];
+  vec3 vPos = generated.position;
+  vec3 vNormal = generated.normal;
+  vec2 vUV = generated.uv;
+  fragBarycentric = vec3(corner % 3u == 0u, corner % 3u == 1u, corner % 3u == 2u);
+#elif COMPACT_VERTEX_FORMAT
+#if QUANTIZED_POSITIONS
+  vec3 vPos = vPositionOffset + vPackedPos * vPositionScale;
+#else // !QUANTIZED_POSITIONS
+  vec3 vPos = vPackedPos;
+#endif // !QUANTIZED_POSITIONS
+  vec3 vNormal = octDecode(clamp(vec2(vFrame.xy) / 32767.0, -1.0, 1.0));
+#endif // VERTEX_PULLING || COMPACT_VERTEX_FORMAT
+
   // TODO transform by model
 	fragPos = vec4(vPos.x, vPos.y, vPos.z, 1.0);
 	fragNormal = vNormal;
 	texCoord = vUV;
+#if MATERIAL_ARRAYS
+	materialIndex = gl_DrawID;
+#endif // MATERIAL_ARRAYS
 
 	float heightStrength = 0.1;
 
@@ -1,13 +1,99 @@
 
+#ifndef BARYCENTRICS
+#define BARYCENTRICS 0
+#endif // BARYCENTRICS
+
+// Barycentrics for the wireframe overlay: 1 interpolated from the previous stage,
+// 2 GL_NV_fragment_shader_barycentric, 3 GL_AMD_shader_explicit_vertex_parameter.
+#if BARYCENTRICS == 2
+#extension GL_NV_fragment_shader_barycentric : require
+#elif BARYCENTRICS == 3
+#extension GL_AMD_shader_explicit_vertex_parameter : require
+#endif // BARYCENTRICS
+
+#ifndef MATERIAL_ARRAYS
+#define MATERIAL_ARRAYS 0
+#endif // MATERIAL_ARRAYS
+
 in vec4 fragPos;
 in vec3 fragNormal;
 in vec2 texCoord;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
+// Matches FrameConstants in frameconstants.h.
+layout(std140, binding = 0) uniform FrameConstants
+{
+  mat4 viewProj;
+  vec4 viewPos;
+};
+
+#if MATERIAL_ARRAYS
+// MATERIAL_BINDING and MAX_MATERIAL_ARRAYS come from MaterialArrays.
+
+// Matches MaterialArrays::Material.
+struct Material
+{
+  int array;
+  int layer;
+  int padding0;
+  int padding1;
+};
+
+layout(std430, binding = MATERIAL_BINDING) readonly buffer materialTable
+{
+  Material materials[];
+};
+
+layout(binding = 0) uniform sampler2DArray materialArrays[MAX_MATERIAL_ARRAYS];
+
+flat in int materialIndex;
+
+vec4 sampleDiffuse(vec2 uv)
+{
+  // The index comes from gl_DrawID, so it is dynamically uniform and may select a sampler.
+  Material material = materials[materialIndex];
+  if (material.array < 0)
+    return vec4(0.5, 0.5, 0.5, 1.0);
+
+  return texture(materialArrays[material.array], vec3(uv, material.layer));
+}
+#else // !MATERIAL_ARRAYS
 uniform sampler2D tex;
 
+vec4 sampleDiffuse(vec2 uv)
+{
+  return texture(tex, uv);
+}
+#endif // !MATERIAL_ARRAYS
+
+#if BARYCENTRICS
+#if BARYCENTRICS == 1
+noperspective in vec3 fragBarycentric;
+#endif // BARYCENTRICS == 1
+
+uniform int wireframe;
+
+vec3 barycentrics()
+{
+#if BARYCENTRICS == 2
+  return gl_BaryCoordNoPerspNV;
+#elif BARYCENTRICS == 3
+  return vec3(gl_BaryCoordNoPerspAMD, 1.0 - gl_BaryCoordNoPerspAMD.x - gl_BaryCoordNoPerspAMD.y);
+#else // BARYCENTRICS == 1
+  return fragBarycentric;
+#endif // BARYCENTRICS == 1
+}
+
+// Coverage of the closest triangle edge, about a pixel wide at any distance.
+float wireframeCoverage()
+{
+  vec3 bary = barycentrics();
+  vec3 edge = smoothstep(vec3(0.0), fwidth(bary) * 1.5, bary);
+  return 1.0 - min(min(edge.x, edge.y), edge.z);
+}
+#endif // BARYCENTRICS
+
 void main()
 {
   vec3 lightColor = vec3(0.8, 0.8, 0.8);
@@ -19,7 +105,7 @@ void main()
   float specPower = 32.0;
 
   vec3 vecToLight = normalize(lightPos - fragPos.xyz);
-  vec3 vecToView = normalize(viewPos - fragPos.xyz);
+  vec3 vecToView = normalize(viewPos.xyz - fragPos.xyz);
 
   vec3 ambient = ambientStrength * lightColor;
 
@@ -34,14 +120,20 @@ void main()
   vec2 uv = texCoord;
   // uv.y = 1 - uv.y;
 
-  objectColor = texture(tex, uv).rgb;
-  float alpha = texture(tex, uv).a;
+  vec4 diffuseSample = sampleDiffuse(uv);
+  objectColor = diffuseSample.rgb;
+  float alpha = diffuseSample.a;
 
   if (alpha < 0.3)
     discard;
 
   vec3 result = (ambient + diffuse + specular) * objectColor;
 
+#if BARYCENTRICS
+  if (wireframe != 0)
+    result = mix(result, vec3(0.02, 0.02, 0.02), wireframeCoverage());
+#endif // BARYCENTRICS
+
   FragColor = vec4(result, 1);
   // FragColor = vec4(fragNormal, 1);
 }
\ No newline at end of file
@@ -11,6 +11,38 @@ struct Vertex {
 #endif //TILEMESH_UVS
 };
 
+#ifndef COMPACT_VERTEX_FORMAT
+#define COMPACT_VERTEX_FORMAT 0
+#endif // COMPACT_VERTEX_FORMAT
+
+#if COMPACT_VERTEX_FORMAT
+// Tile mesh vertex as uploaded by TileGeometryStreams: octahedral snorm16 normal, half2 uv.
+struct PackedVertex {
+    float px, py, pz;
+    uint normal;
+#ifdef TILEMESH_UVS
+    uint uv;
+#endif //TILEMESH_UVS
+};
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+Vertex unpackVertex(PackedVertex p) {
+    Vertex v;
+    v.position = vec3(p.px, p.py, p.pz);
+    v.normal = octDecode(unpackSnorm2x16(p.normal));
+    #ifdef TILEMESH_UVS
+    v.uv = unpackHalf2x16(p.uv);
+    #endif // TILEMESH_UVS
+    return v;
+}
+#endif // COMPACT_VERTEX_FORMAT
+
 Vertex lerpVertex(Vertex a, Vertex b, float t) {
     Vertex v;
     v.position = mix(a.position, b.position, t);
@@ -46,8 +78,15 @@ struct Triangle {
     vec3 n0; float padding5;
     vec3 n1; float padding6;
     vec3 n2; float padding7;
+
+    // Quads only, see TargetGeometryStream::Triangle.
+    vec3 p3; int primitiveType;
+    vec3 n3; float padding8;
 };
 
+const int PRIMITIVE_TRIANGLE = 0;
+const int PRIMITIVE_QUAD = 1;
+
 layout(std430, binding = 0) buffer inputTriangleStream
 {
     Triangle in_Triangles[];
@@ -55,7 +94,11 @@ layout(std430, binding = 0) buffer inputTriangleStream
 
 layout(std430, binding = 1) buffer inputVertexStream
 {
+#if COMPACT_VERTEX_FORMAT
+    PackedVertex in_TileVertices[];
+#else // !COMPACT_VERTEX_FORMAT
     Vertex in_TileVertices[];
+#endif // !COMPACT_VERTEX_FORMAT
 };
 
 layout(std430, binding = 2) buffer inputIndexStream
@@ -75,6 +118,14 @@ layout(std430, binding = 4) buffer outputIndexStream
     uint out_TileIndices[];
 };
 
+Vertex loadTileVertex(uint i) {
+#if COMPACT_VERTEX_FORMAT
+    return unpackVertex(in_TileVertices[i]);
+#else // !COMPACT_VERTEX_FORMAT
+    return in_TileVertices[i];
+#endif // !COMPACT_VERTEX_FORMAT
+}
+
 void projectOntoTriangle(inout Vertex v, in Triangle tri, int tileX, int tileY) {
     // vec3 bitangent = normalize(cross(tri.normal, tri.tangent));
     // mat3 tangentBasis = mat3(tri.tangent, tri.normal, bitangent);
@@ -127,6 +178,42 @@ void projectOntoTriangle(inout Vertex v, in Triangle tri, int tileX, int tileY)
     v.normal = finalNorm;
 }
 
+// Map the tile's [-1, 1] xz extent to the uv rectangle of tile (tileX, tileY).
+void tileToUV(inout Vertex v, int tileX, int tileY) {
+    v.position.xz = v.position.xz * 0.5 + 0.5 + vec2(tileX, tileY);
+}
+
+// Bilinear projection of a vertex in uv space onto a quad. For quads uvToBary0 holds the
+// uv min and uvToBary1 the inverse uv extent.
+void projectOntoQuad(inout Vertex v, in Triangle quad) {
+    vec2 st = (v.position.xz - quad.uvToBary0.xy) * quad.uvToBary1.xy;
+
+    vec3 bottom = mix(quad.p0, quad.p1, st.x);
+    vec3 top = mix(quad.p3, quad.p2, st.x);
+    vec3 surfacePos = mix(bottom, top, st.y);
+
+    // Surface derivatives along u and v.
+    vec3 dPdu = mix(quad.p1 - quad.p0, quad.p2 - quad.p3, st.y) * quad.uvToBary1.x;
+    vec3 dPdv = (top - bottom) * quad.uvToBary1.y;
+
+    #if SMOOTH_NORMALS
+    vec3 interpNormal = normalize(mix(
+        mix(quad.n0, quad.n1, st.x),
+        mix(quad.n3, quad.n2, st.x), st.y));
+    #else // !SMOOTH_NORMALS
+    vec3 interpNormal = quad.normal;
+    #endif // !SMOOTH_NORMALS
+
+    // Temp: match the displacement output
+    interpNormal *= 0.5;
+
+    v.position = surfacePos + v.position.y * interpNormal;
+    v.normal = normalize(
+        dPdu * v.normal.x +
+        dPdv * v.normal.z +
+        v.normal.y * interpNormal);
+}
+
 float planeSide(vec3 v, vec4 plane) {
     return dot(v, plane.xyz) - plane.w;
 }
@@ -265,13 +352,101 @@ void clipMeshToPlane(/*Vertex[SCRATCH_VERTEX_COUNT] vertices, uint numVertices,
     }
 }
 
+// Append the scratch geometry to the output streams.
+void emitScratchGeometry() {
+    if (generated_baseIndex == 0)
+        return;
+
+    uint outBase = atomicAdd(out_baseVertex, generated_baseVertex);
+    for (int i = 0; i < generated_baseVertex; i++)
+        out_Vertices[outBase + i] = generated_Vertices[i];
+
+    uint indexBase = atomicAdd(out_baseIndex, generated_baseIndex);
+    for (int i = 0; i < generated_baseIndex; i++)
+        out_TileIndices[indexBase + i] = outBase + generated_Indices[i];
+}
+
+// Quads span an axis-aligned uv rectangle, so tiles inside it map onto the surface as they
+// are. Only tiles overhanging the rectangle are clipped, in uv space against its edges.
+void generateQuadTiles(in Triangle quad, uint iTileTriangle) {
+    vec2 uvMin = quad.uvToBary0.xy;
+    vec2 uvMax = quad.uvToBary2.xy;
+
+    for (int x = 0; x < quad.numTilesX; x++) {
+        for (int y = 0; y < quad.numTilesY; y++) {
+            int tileX = quad.tileStartX + x;
+            int tileY = quad.tileStartY + y;
+
+            Vertex srcVtx[3];
+            for (int i = 0; i < 3; i++) {
+                srcVtx[i] = loadTileVertex(in_TileIndices[iTileTriangle * 3 + i]);
+                tileToUV(srcVtx[i], tileX, tileY);
+            }
+
+            #if ENABLE_CLIPPING
+            vec2 tileMin = vec2(tileX, tileY);
+            vec2 tileMax = tileMin + 1.0;
+            bvec4 overhang = bvec4(
+                tileMin.x < uvMin.x, tileMax.x > uvMax.x,
+                tileMin.y < uvMin.y, tileMax.y > uvMax.y);
+
+            if (any(overhang)) {
+                vec4 planes[4] = vec4[4](
+                    vec4(-1.0, 0.0, 0.0, -uvMin.x),
+                    vec4(1.0, 0.0, 0.0, uvMax.x),
+                    vec4(0.0, 0.0, -1.0, -uvMin.y),
+                    vec4(0.0, 0.0, 1.0, uvMax.y));
+
+                for (int i = 0; i < 3; i++)
+                    generated_Vertices[i] = srcVtx[i];
+                generated_baseVertex = 3;
+
+                uint srcIdx[SCRATCH_INDEX_COUNT];
+                int numIdx = 3;
+                for (int i = 0; i < 3; i++)
+                    srcIdx[i] = i;
+
+                for (int iPlane = 0; iPlane < 4; iPlane++) {
+                    if (!overhang[iPlane])
+                        continue;
+
+                    generated_baseIndex = 0;
+                    clipMeshToPlane(srcIdx, numIdx, planes[iPlane]);
+                    srcIdx = generated_Indices;
+                    numIdx = generated_baseIndex;
+                }
+
+                for (int i = 0; i < generated_baseVertex; i++)
+                    projectOntoQuad(generated_Vertices[i], quad);
+
+                emitScratchGeometry();
+                continue;
+            }
+            #endif // ENABLE_CLIPPING
+
+            uint outBase = atomicAdd(out_baseVertex, 3);
+            uint indexBase = atomicAdd(out_baseIndex, 3);
+            for (int iVert = 0; iVert < 3; iVert++) {
+                projectOntoQuad(srcVtx[iVert], quad);
+                out_Vertices[outBase + iVert] = srcVtx[iVert];
+                out_TileIndices[indexBase + iVert] = outBase + iVert;
+            }
+        }
+    }
+}
+
 void main() {
     uint tileTriangles = (in_TileIndices.length() / 3);
     uint iTargetTriangle = gl_GlobalInvocationID.x / tileTriangles;
     uint iTileTriangle = gl_GlobalInvocationID.x - (iTargetTriangle * tileTriangles);
-    if (iTargetTriangle > in_Triangles.length())
+    if (iTargetTriangle >= in_Triangles.length())
         return;
-    
+
+    if (in_Triangles[iTargetTriangle].primitiveType == PRIMITIVE_QUAD) {
+        generateQuadTiles(in_Triangles[iTargetTriangle], iTileTriangle);
+        return;
+    }
+
     vec3 triVertex[3];
     triVertex[0] = in_Triangles[iTargetTriangle].p0;
     triVertex[1] = in_Triangles[iTargetTriangle].p1;
@@ -295,7 +470,7 @@ void main() {
             for (int iVert = 0; iVert < 3; iVert++)
             {
                 uint tileIndex = in_TileIndices[iTileTriangle * 3 + iVert];
-                Vertex v = in_TileVertices[tileIndex];
+                Vertex v = loadTileVertex(tileIndex);
                 projectOntoTriangle(v, in_Triangles[iTargetTriangle], tileStartX + x, tileStartY + y);
                 out_Vertices[outBase + iVert] = v;
                 out_TileIndices[indexBase + iVert] = outBase + iVert;
@@ -317,9 +492,9 @@ void main() {
 
             Vertex srcVtx[SCRATCH_VERTEX_COUNT];
             int numVtx = 3;
-            srcVtx[0] = in_TileVertices[srcIdx[0]];
-            srcVtx[1] = in_TileVertices[srcIdx[1]];
-            srcVtx[2] = in_TileVertices[srcIdx[2]];
+            srcVtx[0] = loadTileVertex(srcIdx[0]);
+            srcVtx[1] = loadTileVertex(srcIdx[1]);
+            srcVtx[2] = loadTileVertex(srcIdx[2]);
 
             // Project the initial vertices.
             // int iTile = 0;
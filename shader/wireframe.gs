@@ -0,0 +1,56 @@
+
+// Passes triangles through unchanged and gives each corner its barycentric, for the
+// fragment wireframe on drivers without fragment shader barycentrics. A vertex shared by
+// several triangles is a different corner in each, so earlier stages can't provide it.
+//
+// FRAG_TANGENT forwards the tangent parallax.vs adds, MATERIAL_ARRAYS the material index
+// of batched meshes.
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+#ifndef FRAG_TANGENT
+#define FRAG_TANGENT 0
+#endif // FRAG_TANGENT
+
+#ifndef MATERIAL_ARRAYS
+#define MATERIAL_ARRAYS 0
+#endif // MATERIAL_ARRAYS
+
+in vec4 geom_fragPos[];
+in vec3 geom_fragNormal[];
+in vec2 geom_texCoord[];
+
+out vec4 fragPos;
+out vec3 fragNormal;
+out vec2 texCoord;
+noperspective out vec3 fragBarycentric;
+
+#if FRAG_TANGENT
+in vec4 geom_fragTangent[];
+out vec4 fragTangent;
+#endif // FRAG_TANGENT
+
+#if MATERIAL_ARRAYS
+flat in int geom_materialIndex[];
+flat out int materialIndex;
+#endif // MATERIAL_ARRAYS
+
+void main()
+{
+  for (int i = 0; i < 3; i++)
+  {
+    gl_Position = gl_in[i].gl_Position;
+    fragPos = geom_fragPos[i];
+    fragNormal = geom_fragNormal[i];
+    texCoord = geom_texCoord[i];
+#if FRAG_TANGENT
+    fragTangent = geom_fragTangent[i];
+#endif // FRAG_TANGENT
+#if MATERIAL_ARRAYS
+    materialIndex = geom_materialIndex[i];
+#endif // MATERIAL_ARRAYS
+    fragBarycentric = vec3(i == 0, i == 1, i == 2);
+    EmitVertex();
+  }
+  EndPrimitive();
+}
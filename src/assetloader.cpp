@@ -0,0 +1,135 @@
+#include "assetloader.h"
+#include "texturemanager.h"
+#include <iostream>
+#include <chrono>
+
+static void logScratch(const MeshLoadData& data)
+{
+  std::cout << "AssetLoader: '" << data.file << "' peak scratch " << data.scratch.peakBytes() / 1024 << " KB in "
+    << data.scratch.numBlocks() << " blocks\n";
+}
+
+AssetLoader::AssetLoader(ThreadPool& pool)
+  : m_pool(pool)
+  , m_numPending(0)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+  // Never leave jobs referencing this loader behind.
+  finish();
+}
+
+void AssetLoader::loadMesh(const std::string& file, std::unique_ptr<Mesh>& out)
+{
+  m_numPending++;
+
+  m_pool.submit([this, file, &out] {
+    auto data = std::make_shared<MeshLoadData>();
+    if (!Mesh::prepare(file, *data))
+    {
+      pushGLTask([file] {
+        std::cerr << "AssetLoader: Failed to load mesh '" << file << "'\n";
+        exit(-1);
+      });
+      return;
+    }
+
+    // Diffuse textures stream in once the mesh exists, see TextureStreamer.
+    pushGLTask([data, &out] {
+      out = std::make_unique<Mesh>(*data);
+      logScratch(*data);
+    });
+  });
+}
+
+void AssetLoader::loadTargetMesh(const std::string& file, std::unique_ptr<TargetMesh>& out)
+{
+  m_numPending++;
+
+  m_pool.submit([this, file, &out] {
+    auto data = std::make_shared<MeshLoadData>();
+    if (!TargetMesh::prepare(file, *data))
+    {
+      pushGLTask([file] {
+        std::cerr << "AssetLoader: Failed to load target mesh '" << file << "'\n";
+        exit(-1);
+      });
+      return;
+    }
+
+    pushGLTask([data, &out] {
+      out = std::make_unique<TargetMesh>(*data);
+      logScratch(*data);
+    });
+  });
+}
+
+void AssetLoader::loadTileMesh(const std::string& file, std::unique_ptr<TileMesh>& out)
+{
+  m_numPending++;
+
+  m_pool.submit([this, file, &out] {
+    auto data = std::make_shared<MeshLoadData>();
+    if (!TileMesh::prepare(file, *data))
+    {
+      pushGLTask([file] {
+        std::cerr << "AssetLoader: Failed to load tile mesh '" << file << "'\n";
+        exit(-1);
+      });
+      return;
+    }
+
+    pushGLTask([data, &out] {
+      out = std::make_unique<TileMesh>(*data);
+      logScratch(*data);
+    });
+  });
+}
+
+void AssetLoader::loadTexture(const std::string& file, std::shared_ptr<Texture>& out, TextureUsage usage, TextureCompression compression)
+{
+  // Not waited for by finish(), the texture binds a placeholder until it has streamed in.
+  out = TextureManager::global().acquire(file, usage, compression);
+}
+
+void AssetLoader::finish()
+{
+  auto start = std::chrono::steady_clock::now();
+  size_t numLoaded = 0;
+
+  while (m_numPending > 0)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_glTaskReady.wait(lock, [this] { return !m_glTasks.empty(); });
+
+      task = std::move(m_glTasks.front());
+      m_glTasks.pop_front();
+    }
+
+    task();
+    m_numPending--;
+    numLoaded++;
+  }
+
+  // Parsed geometry only needs to live while loaders can still share it.
+  GeometryCache::clear();
+
+  if (numLoaded > 0)
+  {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "AssetLoader: Loaded " << numLoaded << " assets in " << elapsed.count() << "s on " << m_pool.numThreads() << " threads.\n";
+  }
+}
+
+void AssetLoader::pushGLTask(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_glTasks.push_back(std::move(task));
+  }
+  m_glTaskReady.notify_one();
+}
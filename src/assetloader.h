@@ -0,0 +1,49 @@
+#ifndef _ASSETLOADER_H
+#define _ASSETLOADER_H
+#include <string>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include "mesh.h"
+#include "texture.h"
+#include "texturecache.h"
+#include "threadpool.h"
+
+// Two-stage startup loader. File parsing and tangent and triangle precompute run on the
+// thread pool; the resulting GL objects are created on the calling thread by finish() as
+// each CPU job completes. Textures are handed to TextureStreamer and are not waited for.
+class AssetLoader
+{
+protected:
+  ThreadPool& m_pool;
+
+  std::mutex m_mutex;
+  std::condition_variable m_glTaskReady;
+  std::deque<std::function<void()>> m_glTasks;
+  size_t m_numPending;
+
+public:
+  AssetLoader(ThreadPool& pool = ThreadPool::global());
+  ~AssetLoader();
+
+  // delete copy constructor
+  AssetLoader(const AssetLoader&) = delete;
+  AssetLoader& operator=(const AssetLoader&) = delete;
+
+  // The output pointers are written by finish() and must stay valid until it returns.
+  // loadTexture() writes its output right away.
+  void loadMesh(const std::string& file, std::unique_ptr<Mesh>& out);
+  void loadTargetMesh(const std::string& file, std::unique_ptr<TargetMesh>& out);
+  void loadTileMesh(const std::string& file, std::unique_ptr<TileMesh>& out);
+  void loadTexture(const std::string& file, std::shared_ptr<Texture>& out, TextureUsage usage, TextureCompression compression = TextureCompression::None);
+
+  // Run the GL stage of every queued asset on the calling thread, blocking until all are created.
+  void finish();
+
+protected:
+  void pushGLTask(std::function<void()> task);
+};
+
+#endif // _ASSETLOADER_H
@@ -0,0 +1,562 @@
+#include "blockcompress.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+
+// BC7 interpolation weights for 4 bit indices, out of 64.
+static const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Block rows per parallel work item.
+static const int ENCODE_ROWS_PER_JOB = 4;
+
+template <int N>
+static void loadBlock(const uint8_t* rgba, float (*px)[4], float* mean)
+{
+  for (int c = 0; c < N; c++)
+    mean[c] = 0.f;
+
+  for (int i = 0; i < 16; i++)
+  {
+    for (int c = 0; c < N; c++)
+    {
+      px[i][c] = rgba[i * 4 + c];
+      mean[c] += px[i][c];
+    }
+  }
+
+  for (int c = 0; c < N; c++)
+    mean[c] /= 16.f;
+}
+
+// Principal axis of the block's texels by power iteration on their covariance. Returns
+// false for blocks of a single color.
+template <int N>
+static bool principalAxis(const float (*px)[4], const float* mean, float* axis)
+{
+  float cov[N][N] = {};
+  for (int i = 0; i < 16; i++)
+  {
+    float d[N];
+    for (int c = 0; c < N; c++)
+      d[c] = px[i][c] - mean[c];
+
+    for (int a = 0; a < N; a++)
+    {
+      for (int b = 0; b < N; b++)
+        cov[a][b] += d[a] * d[b];
+    }
+  }
+
+  // Start from the row of the channel with the largest variance, which is never
+  // orthogonal to the principal axis.
+  int largest = 0;
+  for (int c = 1; c < N; c++)
+  {
+    if (cov[c][c] > cov[largest][largest])
+      largest = c;
+  }
+
+  if (cov[largest][largest] <= 0.f)
+    return false;
+
+  for (int c = 0; c < N; c++)
+    axis[c] = cov[largest][c];
+
+  for (int iter = 0; iter < 8; iter++)
+  {
+    float next[N] = {};
+    float maxAbs = 0.f;
+    for (int a = 0; a < N; a++)
+    {
+      for (int b = 0; b < N; b++)
+        next[a] += cov[a][b] * axis[b];
+      maxAbs = std::max(maxAbs, std::abs(next[a]));
+    }
+
+    if (maxAbs <= 0.f)
+      break;
+
+    for (int c = 0; c < N; c++)
+      axis[c] = next[c] / maxAbs;
+  }
+
+  float len = 0.f;
+  for (int c = 0; c < N; c++)
+    len += axis[c] * axis[c];
+  len = std::sqrt(len);
+  if (len <= 0.f)
+    return false;
+
+  for (int c = 0; c < N; c++)
+    axis[c] /= len;
+  return true;
+}
+
+// Endpoints at the extremes of the texels projected onto the principal axis.
+template <int N>
+static void axisEndpoints(const float (*px)[4], const float* mean, float* e0, float* e1)
+{
+  float axis[N];
+  if (!principalAxis<N>(px, mean, axis))
+  {
+    for (int c = 0; c < N; c++)
+      e0[c] = e1[c] = mean[c];
+    return;
+  }
+
+  float tMin = 0.f;
+  float tMax = 0.f;
+  for (int i = 0; i < 16; i++)
+  {
+    float t = 0.f;
+    for (int c = 0; c < N; c++)
+      t += (px[i][c] - mean[c]) * axis[c];
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+  }
+
+  for (int c = 0; c < N; c++)
+  {
+    e0[c] = std::clamp(mean[c] + axis[c] * tMin, 0.f, 255.f);
+    e1[c] = std::clamp(mean[c] + axis[c] * tMax, 0.f, 255.f);
+  }
+}
+
+// Least squares endpoints for fixed interpolation weights, texel i = lerp(e0, e1, weights[i]).
+template <int N>
+static bool refineEndpoints(const float (*px)[4], const float* weights, float* e0, float* e1)
+{
+  float alpha2 = 0.f, beta2 = 0.f, alphaBeta = 0.f;
+  float alphaX[N] = {}, betaX[N] = {};
+  for (int i = 0; i < 16; i++)
+  {
+    float beta = weights[i];
+    float alpha = 1.f - beta;
+    alpha2 += alpha * alpha;
+    beta2 += beta * beta;
+    alphaBeta += alpha * beta;
+    for (int c = 0; c < N; c++)
+    {
+      alphaX[c] += alpha * px[i][c];
+      betaX[c] += beta * px[i][c];
+    }
+  }
+
+  float det = alpha2 * beta2 - alphaBeta * alphaBeta;
+  if (std::abs(det) < 1e-6f)
+    return false;
+
+  for (int c = 0; c < N; c++)
+  {
+    e0[c] = std::clamp((alphaX[c] * beta2 - betaX[c] * alphaBeta) / det, 0.f, 255.f);
+    e1[c] = std::clamp((betaX[c] * alpha2 - alphaX[c] * alphaBeta) / det, 0.f, 255.f);
+  }
+  return true;
+}
+
+static inline uint16_t packRGB565(const float* c)
+{
+  int r = (int)std::lround(c[0] * 31.f / 255.f);
+  int g = (int)std::lround(c[1] * 63.f / 255.f);
+  int b = (int)std::lround(c[2] * 31.f / 255.f);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static inline void unpackRGB565(uint16_t c, float* out)
+{
+  int r = (c >> 11) & 31;
+  int g = (c >> 5) & 63;
+  int b = c & 31;
+  out[0] = (float)((r << 3) | (r >> 2));
+  out[1] = (float)((g << 2) | (g >> 4));
+  out[2] = (float)((b << 3) | (b >> 2));
+}
+
+// Quantize the endpoints and pick indices in four color mode. Returns the squared error,
+// weights receive each texel's position from color 0 to color 1.
+static float fitBC1(const float (*px)[4], const float* e0, const float* e1, uint16_t& c0, uint16_t& c1, uint32_t& indices, float* weights)
+{
+  c0 = packRGB565(e0);
+  c1 = packRGB565(e1);
+  if (c0 < c1)
+    std::swap(c0, c1);
+
+  indices = 0;
+  if (c0 == c1)
+  {
+    // Three color mode with every texel on color 0.
+    float color[3];
+    unpackRGB565(c0, color);
+
+    float error = 0.f;
+    for (int i = 0; i < 16; i++)
+    {
+      weights[i] = 0.f;
+      for (int c = 0; c < 3; c++)
+        error += (px[i][c] - color[c]) * (px[i][c] - color[c]);
+    }
+    return error;
+  }
+
+  float palette[4][3];
+  unpackRGB565(c0, palette[0]);
+  unpackRGB565(c1, palette[1]);
+  for (int c = 0; c < 3; c++)
+  {
+    palette[2][c] = (2.f * palette[0][c] + palette[1][c]) / 3.f;
+    palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) / 3.f;
+  }
+
+  // Position of each index between color 0 and color 1.
+  static const float INDEX_WEIGHTS[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+
+  float error = 0.f;
+  for (int i = 0; i < 16; i++)
+  {
+    int best = 0;
+    float bestError = FLT_MAX;
+    for (int k = 0; k < 4; k++)
+    {
+      float e = 0.f;
+      for (int c = 0; c < 3; c++)
+        e += (px[i][c] - palette[k][c]) * (px[i][c] - palette[k][c]);
+      if (e < bestError)
+      {
+        bestError = e;
+        best = k;
+      }
+    }
+
+    indices |= (uint32_t)best << (2 * i);
+    weights[i] = INDEX_WEIGHTS[best];
+    error += bestError;
+  }
+  return error;
+}
+
+void BlockCompress::encodeBC1(const uint8_t* rgba, uint8_t* out)
+{
+  float px[16][4];
+  float mean[3];
+  loadBlock<3>(rgba, px, mean);
+
+  float e0[3], e1[3];
+  axisEndpoints<3>(px, mean, e0, e1);
+
+  uint16_t c0, c1;
+  uint32_t indices;
+  float weights[16];
+  float error = fitBC1(px, e0, e1, c0, c1, indices, weights);
+
+  float r0[3], r1[3];
+  if (error > 0.f && refineEndpoints<3>(px, weights, r0, r1))
+  {
+    uint16_t rc0, rc1;
+    uint32_t rIndices;
+    float rWeights[16];
+    float rError = fitBC1(px, r0, r1, rc0, rc1, rIndices, rWeights);
+    if (rError < error)
+    {
+      c0 = rc0;
+      c1 = rc1;
+      indices = rIndices;
+    }
+  }
+
+  out[0] = (uint8_t)(c0 & 0xFF);
+  out[1] = (uint8_t)(c0 >> 8);
+  out[2] = (uint8_t)(c1 & 0xFF);
+  out[3] = (uint8_t)(c1 >> 8);
+  memcpy(out + 4, &indices, 4);
+}
+
+void BlockCompress::encodeBC4(const uint8_t* rgba, int channel, uint8_t* out)
+{
+  int minValue = 255;
+  int maxValue = 0;
+  for (int i = 0; i < 16; i++)
+  {
+    minValue = std::min(minValue, (int)rgba[i * 4 + channel]);
+    maxValue = std::max(maxValue, (int)rgba[i * 4 + channel]);
+  }
+
+  out[0] = (uint8_t)maxValue;
+  out[1] = (uint8_t)minValue;
+
+  uint64_t indices = 0;
+  if (maxValue > minValue)
+  {
+    // Eight value mode: index 0 is the max, 1 the min and 2..7 step from max to min.
+    float scale = 7.f / (float)(maxValue - minValue);
+    for (int i = 0; i < 16; i++)
+    {
+      int step = (int)std::lround((maxValue - rgba[i * 4 + channel]) * scale);
+      uint64_t index = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+      indices |= index << (3 * i);
+    }
+  }
+
+  for (int i = 0; i < 6; i++)
+    out[2 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+void BlockCompress::encodeBC5(const uint8_t* rgba, uint8_t* out)
+{
+  encodeBC4(rgba, 0, out);
+  encodeBC4(rgba, 1, out + 8);
+}
+
+// Mode 6 endpoint: seven bits per channel plus a p-bit shared by the channels.
+struct BC7Endpoint
+{
+  int q[4];
+  int p;
+
+  inline int value(int c) const { return (q[c] << 1) | p; }
+};
+
+static BC7Endpoint quantizeBC7(const float* e)
+{
+  BC7Endpoint best = {};
+  float bestError = -1.f;
+  for (int p = 0; p < 2; p++)
+  {
+    BC7Endpoint endpoint;
+    endpoint.p = p;
+    float error = 0.f;
+    for (int c = 0; c < 4; c++)
+    {
+      endpoint.q[c] = std::clamp((int)std::lround((e[c] - p) * 0.5f), 0, 127);
+      float d = (float)endpoint.value(c) - e[c];
+      error += d * d;
+    }
+
+    if (bestError < 0.f || error < bestError)
+    {
+      best = endpoint;
+      bestError = error;
+    }
+  }
+  return best;
+}
+
+static float fitBC7(const float (*px)[4], const float* e0, const float* e1, BC7Endpoint& q0, BC7Endpoint& q1, uint8_t* indices, float* weights)
+{
+  q0 = quantizeBC7(e0);
+  q1 = quantizeBC7(e1);
+
+  float palette[16][4];
+  for (int k = 0; k < 16; k++)
+  {
+    for (int c = 0; c < 4; c++)
+      palette[k][c] = (float)(((64 - BC7_WEIGHTS4[k]) * q0.value(c) + BC7_WEIGHTS4[k] * q1.value(c) + 32) >> 6);
+  }
+
+  float error = 0.f;
+  for (int i = 0; i < 16; i++)
+  {
+    int best = 0;
+    float bestError = FLT_MAX;
+    for (int k = 0; k < 16; k++)
+    {
+      float e = 0.f;
+      for (int c = 0; c < 4; c++)
+        e += (px[i][c] - palette[k][c]) * (px[i][c] - palette[k][c]);
+      if (e < bestError)
+      {
+        bestError = e;
+        best = k;
+      }
+    }
+
+    indices[i] = (uint8_t)best;
+    weights[i] = BC7_WEIGHTS4[best] / 64.f;
+    error += bestError;
+  }
+  return error;
+}
+
+// Little-endian bit stream over a 16 byte block.
+struct BlockWriter
+{
+  uint8_t* out;
+  int bit;
+
+  inline void write(uint32_t value, int numBits)
+  {
+    for (int i = 0; i < numBits; i++, bit++)
+    {
+      if (value & (1u << i))
+        out[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+    }
+  }
+};
+
+void BlockCompress::encodeBC7(const uint8_t* rgba, uint8_t* out)
+{
+  float px[16][4];
+  float mean[4];
+  loadBlock<4>(rgba, px, mean);
+
+  float e0[4], e1[4];
+  axisEndpoints<4>(px, mean, e0, e1);
+
+  BC7Endpoint q0, q1;
+  uint8_t indices[16];
+  float weights[16];
+  float error = fitBC7(px, e0, e1, q0, q1, indices, weights);
+
+  float r0[4], r1[4];
+  if (error > 0.f && refineEndpoints<4>(px, weights, r0, r1))
+  {
+    BC7Endpoint rq0, rq1;
+    uint8_t rIndices[16];
+    float rWeights[16];
+    if (fitBC7(px, r0, r1, rq0, rq1, rIndices, rWeights) < error)
+    {
+      q0 = rq0;
+      q1 = rq1;
+      memcpy(indices, rIndices, sizeof(indices));
+    }
+  }
+
+  // The first texel's index drops its top bit, swap the endpoints so it is clear.
+  if (indices[0] & 8)
+  {
+    std::swap(q0, q1);
+    for (int i = 0; i < 16; i++)
+      indices[i] = (uint8_t)(15 - indices[i]);
+  }
+
+  memset(out, 0, 16);
+  BlockWriter writer = { out, 0 };
+  writer.write(1u << 6, 7);
+  for (int c = 0; c < 4; c++)
+  {
+    writer.write((uint32_t)q0.q[c], 7);
+    writer.write((uint32_t)q1.q[c], 7);
+  }
+  writer.write((uint32_t)q0.p, 1);
+  writer.write((uint32_t)q1.p, 1);
+
+  writer.write(indices[0], 3);
+  for (int i = 1; i < 16; i++)
+    writer.write(indices[i], 4);
+}
+
+bool BlockCompress::isCompressed(TextureEncoding encoding)
+{
+  return blockBytes(encoding) != 0;
+}
+
+int BlockCompress::numChannels(TextureEncoding encoding)
+{
+  switch (encoding)
+  {
+  case TextureEncoding::R8:
+  case TextureEncoding::R16:
+  case TextureEncoding::BC4:
+    return 1;
+  case TextureEncoding::RG8:
+  case TextureEncoding::BC5:
+    return 2;
+  case TextureEncoding::RGB8:
+    return 3;
+  default:
+    return 4;
+  }
+}
+
+size_t BlockCompress::blockBytes(TextureEncoding encoding)
+{
+  switch (encoding)
+  {
+  case TextureEncoding::BC1:
+  case TextureEncoding::BC4:
+    return 8;
+  case TextureEncoding::BC5:
+  case TextureEncoding::BC7:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+size_t BlockCompress::texelBytes(TextureEncoding encoding)
+{
+  switch (encoding)
+  {
+  case TextureEncoding::R8: return 1;
+  case TextureEncoding::RG8: return 2;
+  case TextureEncoding::RGB8: return 3;
+  case TextureEncoding::RGBA8: return 4;
+  case TextureEncoding::R16: return 2;
+  case TextureEncoding::RGBA16F: return 8;
+  default: return 0;
+  }
+}
+
+size_t BlockCompress::encodedSize(TextureEncoding encoding, int width, int height)
+{
+  if (!isCompressed(encoding))
+    return (size_t)width * height * texelBytes(encoding);
+
+  size_t blocksX = (width + 3) / 4;
+  size_t blocksY = (height + 3) / 4;
+  return blocksX * blocksY * blockBytes(encoding);
+}
+
+void BlockCompress::encodeImage(TextureEncoding encoding, const uint8_t* rgba, int width, int height, uint8_t* out)
+{
+  if (!isCompressed(encoding))
+  {
+    const size_t numTexels = (size_t)width * height;
+    const int channels = numChannels(encoding);
+    if (channels == 4)
+    {
+      memcpy(out, rgba, numTexels * 4);
+      return;
+    }
+
+    for (size_t i = 0; i < numTexels; i++)
+      memcpy(out + i * channels, rgba + i * 4, channels);
+    return;
+  }
+
+  const int blocksX = (width + 3) / 4;
+  const int blocksY = (height + 3) / 4;
+  const size_t bytes = blockBytes(encoding);
+  const size_t numJobs = (blocksY + ENCODE_ROWS_PER_JOB - 1) / ENCODE_ROWS_PER_JOB;
+
+  ThreadPool::global().parallelFor(numJobs, [&](size_t iJob) {
+    int rowEnd = std::min(blocksY, (int)(iJob + 1) * ENCODE_ROWS_PER_JOB);
+    for (int by = (int)iJob * ENCODE_ROWS_PER_JOB; by < rowEnd; by++)
+    {
+      for (int bx = 0; bx < blocksX; bx++)
+      {
+        uint8_t block[64];
+        for (int y = 0; y < 4; y++)
+        {
+          int sy = std::min(by * 4 + y, height - 1);
+          for (int x = 0; x < 4; x++)
+          {
+            int sx = std::min(bx * 4 + x, width - 1);
+            memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+          }
+        }
+
+        uint8_t* dst = out + ((size_t)by * blocksX + bx) * bytes;
+        switch (encoding)
+        {
+        case TextureEncoding::BC1: encodeBC1(block, dst); break;
+        case TextureEncoding::BC4: encodeBC4(block, 0, dst); break;
+        case TextureEncoding::BC5: encodeBC5(block, dst); break;
+        case TextureEncoding::BC7: encodeBC7(block, dst); break;
+        default: break;
+        }
+      }
+    }
+  });
+}
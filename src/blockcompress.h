@@ -0,0 +1,49 @@
+#ifndef _BLOCKCOMPRESS_H
+#define _BLOCKCOMPRESS_H
+#include <cstdint>
+#include <cstddef>
+
+// Storage formats of cached textures.
+enum class TextureEncoding : uint32_t
+{
+  R8,
+  RG8,
+  RGB8,
+  RGBA8,
+  R16,
+  RGBA16F,
+  BC1,
+  BC4,
+  BC5,
+  BC7,
+
+  Count
+};
+
+// CPU block compression of RGBA8 images. Blocks are 4x4 texels; encoders take the texels
+// in row order, four bytes each.
+//
+// BC1 fits the endpoints to the principal axis of the block's colors and refines them by
+// least squares. BC4/BC5 use the channel range. BC7 only uses mode 6 (one subset, RGBA
+// endpoints, 4 bit indices), which is a good match for smooth material textures.
+class BlockCompress
+{
+public:
+  static void encodeBC1(const uint8_t* rgba, uint8_t* out);
+  static void encodeBC4(const uint8_t* rgba, int channel, uint8_t* out);
+  static void encodeBC5(const uint8_t* rgba, uint8_t* out);
+  static void encodeBC7(const uint8_t* rgba, uint8_t* out);
+
+  // Compress a whole image, `rgba` holds width * height texels without row padding. Edge
+  // blocks repeat the last row and column. Runs on the thread pool. Uncompressed 8 bit
+  // encodings keep the leading channels; R16 and RGBA16F are not produced from RGBA8.
+  static void encodeImage(TextureEncoding encoding, const uint8_t* rgba, int width, int height, uint8_t* out);
+
+  static bool isCompressed(TextureEncoding encoding);
+  static int numChannels(TextureEncoding encoding);
+  static size_t blockBytes(TextureEncoding encoding);
+  static size_t texelBytes(TextureEncoding encoding);
+  static size_t encodedSize(TextureEncoding encoding, int width, int height);
+};
+
+#endif // _BLOCKCOMPRESS_H
@@ -1,18 +1,99 @@
 #include "buffer.h"
 #include <iostream>
+#include <cstring>
+
+static const GLbitfield RING_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
 
 UniformBuffer::UniformBuffer(void* data, size_t len)
+  : mapped(nullptr)
+  , frameSize(0)
+  , alignment(1)
+  , frame(0)
+  , offset(0)
+  , fences()
 {
   glGenBuffers(1, &id);
   setData(data, len);
 }
 
+UniformBuffer::UniformBuffer(size_t frameSize)
+  : mapped(nullptr)
+  , frameSize(frameSize)
+  , alignment(1)
+  , frame(0)
+  , offset(0)
+  , fences()
+{
+  GLint offsetAlignment = 1;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+  alignment = (size_t)offsetAlignment;
+  this->frameSize = (frameSize + alignment - 1) / alignment * alignment;
+
+  size_t size = this->frameSize * FRAMES_IN_FLIGHT;
+  glCreateBuffers(1, &id);
+  glNamedBufferStorage(id, size, nullptr, RING_FLAGS);
+  mapped = (unsigned char*)glMapNamedBufferRange(id, 0, size, RING_FLAGS);
+  if (!mapped)
+    std::cerr << "UniformBuffer::UniformBuffer> Failed to map the uniform ring.\n";
+}
+
 UniformBuffer::~UniformBuffer()
 {
+  for (GLsync fence : fences)
+  {
+    if (fence)
+      glDeleteSync(fence);
+  }
+
   std::cout << "DEBUG: Delete uniform buffer " << id << "\n";
   glDeleteBuffers(1, &id);
 }
 
+void UniformBuffer::bind(GLuint binding) const
+{
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, id);
+}
+
+void UniformBuffer::beginFrame()
+{
+  frame = (frame + 1) % FRAMES_IN_FLIGHT;
+  offset = 0;
+
+  GLsync& fence = fences[frame];
+  if (fence)
+  {
+    // Signalled long ago unless the GPU has fallen a whole ring behind.
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+      ;
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+}
+
+void UniformBuffer::endFrame()
+{
+  fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLintptr UniformBuffer::allocate(const void* data, size_t len)
+{
+  if (!mapped || offset + len > frameSize)
+  {
+    std::cerr << "UniformBuffer::allocate> Frame slot of " << frameSize << " bytes is full.\n";
+    return -1;
+  }
+
+  GLintptr at = (GLintptr)(frameSize * frame + offset);
+  memcpy(mapped + at, data, len);
+  offset = (offset + len + alignment - 1) / alignment * alignment;
+  return at;
+}
+
+void UniformBuffer::bindRange(GLuint binding, GLintptr offset, size_t len) const
+{
+  glBindBufferRange(GL_UNIFORM_BUFFER, binding, id, offset, len);
+}
+
 void UniformBuffer::setData(void* data, size_t len)
 {
   glNamedBufferData(id, len, data, GL_STATIC_DRAW);
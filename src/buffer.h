@@ -2,19 +2,46 @@
 #define _BUFFER_H
 #include <glad/glad.h>
 
+// Either static data, or a ring of FRAMES_IN_FLIGHT per-frame slots in one persistently
+// mapped buffer. Each frame writes its constants straight into its slot and binds ranges
+// of it; a fence per slot keeps the CPU from overwriting a slot the GPU still reads.
 class UniformBuffer
 {
+public:
+  static const int FRAMES_IN_FLIGHT = 3;
+
 protected:
   GLuint id;
 
+  unsigned char* mapped;
+  size_t frameSize;
+  size_t alignment;
+  int frame;
+  size_t offset;
+  GLsync fences[FRAMES_IN_FLIGHT];
+
 public:
   UniformBuffer(void* data, size_t len);
+  // Ring with `frameSize` bytes per frame.
+  UniformBuffer(size_t frameSize);
   ~UniformBuffer();
 
   // Delete copy constructors
   UniformBuffer(const UniformBuffer&) = delete;
   UniformBuffer& operator=(const UniformBuffer&) = delete;
 
+  void bind(GLuint binding) const;
+
+  // Moves to the next slot, waiting only if the GPU is still FRAMES_IN_FLIGHT frames behind.
+  void beginFrame();
+  // Fences the slot written since beginFrame().
+  void endFrame();
+
+  // Copies `data` into this frame's slot at the next aligned offset. Returns the offset,
+  // or -1 once the slot is full.
+  GLintptr allocate(const void* data, size_t len);
+  void bindRange(GLuint binding, GLintptr offset, size_t len) const;
+
 protected:
   void setData(void* data, size_t len);
 };
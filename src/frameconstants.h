@@ -0,0 +1,26 @@
+#ifndef _FRAMECONSTANTS_H
+#define _FRAMECONSTANTS_H
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// std140 uniform blocks shared by every program, sub-allocated from the per-frame
+// UniformBuffer ring. The shaders declare matching blocks at the same bindings.
+
+// Camera constants, written once per frame.
+struct FrameConstants
+{
+  static const GLuint BINDING = 0;
+
+  glm::mat4 viewProj;
+  glm::vec4 viewPos;
+};
+
+// Constants that change per draw.
+struct DrawConstants
+{
+  static const GLuint BINDING = 1;
+
+  glm::mat4 model;
+};
+
+#endif // _FRAMECONSTANTS_H
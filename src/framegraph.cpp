@@ -0,0 +1,190 @@
+#include "framegraph.h"
+#include <iostream>
+
+static const GLbitfield READ_BARRIERS = GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+  | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT
+  | GL_UNIFORM_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT
+  | GL_FRAMEBUFFER_BARRIER_BIT;
+
+// The barrier that makes an earlier shader write visible to this kind of access.
+static GLbitfield barrierBit(FrameGraph::Access access)
+{
+  switch (access)
+  {
+  case FrameGraph::Access::StorageRead:
+  case FrameGraph::Access::StorageWrite: return GL_SHADER_STORAGE_BARRIER_BIT;
+  case FrameGraph::Access::ImageWrite: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+  case FrameGraph::Access::VertexRead: return GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+  case FrameGraph::Access::IndexRead: return GL_ELEMENT_ARRAY_BARRIER_BIT;
+  case FrameGraph::Access::IndirectRead: return GL_COMMAND_BARRIER_BIT;
+  case FrameGraph::Access::UniformRead: return GL_UNIFORM_BARRIER_BIT;
+  case FrameGraph::Access::TextureRead: return GL_TEXTURE_FETCH_BARRIER_BIT;
+  case FrameGraph::Access::TransferRead:
+  case FrameGraph::Access::TransferWrite: return GL_BUFFER_UPDATE_BARRIER_BIT;
+  case FrameGraph::Access::RenderTarget: return GL_FRAMEBUFFER_BARRIER_BIT;
+  default: return 0;
+  }
+}
+
+static inline bool isWrite(FrameGraph::Access access)
+{
+  return access == FrameGraph::Access::StorageWrite
+    || access == FrameGraph::Access::ImageWrite
+    || access == FrameGraph::Access::TransferWrite
+    || access == FrameGraph::Access::RenderTarget;
+}
+
+// Writes through shader storage and images are incoherent, everything else is ordered by GL.
+static inline bool isShaderWrite(FrameGraph::Access access)
+{
+  return access == FrameGraph::Access::StorageWrite || access == FrameGraph::Access::ImageWrite;
+}
+
+FrameGraph::Pass& FrameGraph::Pass::uses(ResourceId resource, Access access)
+{
+  m_uses.push_back({ resource, access });
+  return *this;
+}
+
+FrameGraph::Pass& FrameGraph::Pass::keep(bool bKeep)
+{
+  m_bKeep = bKeep;
+  return *this;
+}
+
+FrameGraph::FrameGraph()
+  : m_numCulled(0)
+  , m_numBarriers(0)
+{
+  m_resources.push_back({ "backbuffer", 0 });
+}
+
+FrameGraph::~FrameGraph()
+{
+  for (auto& [name, query] : m_queries)
+    glDeleteQueries(1, &query);
+}
+
+FrameGraph::ResourceId FrameGraph::addResource(const std::string& name)
+{
+  m_resources.push_back({ name, 0 });
+  return (ResourceId)(m_resources.size() - 1);
+}
+
+FrameGraph::Pass& FrameGraph::addPass(const std::string& name, std::function<void()> execute)
+{
+  return m_passes.emplace_back(name, std::move(execute));
+}
+
+void FrameGraph::cull()
+{
+  // Walk back from the passes with visible effects, keeping whatever produces their inputs.
+  std::vector<bool> needed(m_resources.size(), false);
+  for (auto pass = m_passes.rbegin(); pass != m_passes.rend(); ++pass)
+  {
+    pass->m_bLive = pass->m_bKeep;
+    for (const Pass::Use& use : pass->m_uses)
+    {
+      if (use.resource == BACKBUFFER || (isWrite(use.access) && needed[use.resource]))
+        pass->m_bLive = true;
+    }
+
+    if (!pass->m_bLive)
+      continue;
+
+    for (const Pass::Use& use : pass->m_uses)
+    {
+      if (!isWrite(use.access))
+        needed[use.resource] = true;
+    }
+  }
+}
+
+void FrameGraph::execute()
+{
+  cull();
+
+  m_numCulled = 0;
+  m_numBarriers = 0;
+  for (Pass& pass : m_passes)
+  {
+    if (!pass.m_bLive)
+    {
+      m_numCulled++;
+      continue;
+    }
+
+    GLStats::Counters countersBefore = GLStats::current();
+
+    GLbitfield barriers = 0;
+    for (const Pass::Use& use : pass.m_uses)
+      barriers |= m_resources[use.resource].pendingBarriers & barrierBit(use.access);
+
+    if (barriers)
+    {
+      glMemoryBarrier(barriers);
+      m_numBarriers++;
+
+      // The barrier is global, it covers every resource written so far.
+      for (Resource& resource : m_resources)
+        resource.pendingBarriers &= ~barriers;
+    }
+
+    GLuint& query = m_queries[pass.m_name];
+    if (!query)
+      glGenQueries(1, &query);
+    pass.m_query = query;
+
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    pass.m_execute();
+    glEndQuery(GL_TIME_ELAPSED);
+
+    pass.m_counters = GLStats::difference(countersBefore, GLStats::current());
+
+    for (const Pass::Use& use : pass.m_uses)
+    {
+      if (isShaderWrite(use.access))
+        m_resources[use.resource].pendingBarriers = READ_BARRIERS;
+    }
+  }
+}
+
+void FrameGraph::resolve()
+{
+  m_results.clear();
+  for (const Pass& pass : m_passes)
+  {
+    if (!pass.m_bLive)
+      continue;
+
+    GLuint64 time = 0;
+    glGetQueryObjectui64v(pass.m_query, GL_QUERY_RESULT, &time);
+    m_results.push_back({ pass.m_name, time, pass.m_counters });
+  }
+
+  m_passes.clear();
+}
+
+const FrameGraph::PassResult* FrameGraph::findResult(const std::string& name) const
+{
+  for (const PassResult& result : m_results)
+  {
+    if (result.name == name)
+      return &result;
+  }
+  return nullptr;
+}
+
+GLuint64 FrameGraph::getPassTime(const std::string& name) const
+{
+  const PassResult* result = findResult(name);
+  return result ? result->time : 0;
+}
+
+GLuint64 FrameGraph::getTotalTime() const
+{
+  GLuint64 total = 0;
+  for (const PassResult& result : m_results)
+    total += result.time;
+  return total;
+}
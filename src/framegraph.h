@@ -0,0 +1,124 @@
+#ifndef _FRAMEGRAPH_H
+#define _FRAMEGRAPH_H
+#include <glad/glad.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+#include "glstats.h"
+
+// The frame as a list of passes that declare how they use each resource. execute() culls
+// passes whose outputs no live pass reads, issues a single glMemoryBarrier before a pass
+// with only the bits its reads of shader-written resources need, and times every pass
+// with its own query.
+//
+// Passes are added again every frame in execution order. Resources and their pending
+// barriers persist, so a compute write in one frame is still made visible to a draw that
+// reads it in a later one.
+class FrameGraph
+{
+public:
+  typedef uint32_t ResourceId;
+
+  // The default framebuffer; a pass that renders to it is always live.
+  static const ResourceId BACKBUFFER = 0;
+
+  enum class Access : uint32_t
+  {
+    StorageRead,
+    StorageWrite,
+    ImageWrite,
+    VertexRead,
+    IndexRead,
+    IndirectRead,
+    UniformRead,
+    TextureRead,
+    TransferRead,
+    TransferWrite,
+    RenderTarget,
+  };
+
+  class Pass
+  {
+    friend class FrameGraph;
+
+  protected:
+    struct Use
+    {
+      ResourceId resource;
+      Access access;
+    };
+
+    std::string m_name;
+    std::function<void()> m_execute;
+    std::vector<Use> m_uses;
+    bool m_bKeep;
+    bool m_bLive;
+    GLuint m_query;
+    GLStats::Counters m_counters;
+
+  public:
+    Pass(const std::string& name, std::function<void()> execute)
+      : m_name(name), m_execute(std::move(execute)), m_bKeep(false), m_bLive(false), m_query(0), m_counters() { }
+
+    Pass& uses(ResourceId resource, Access access);
+    // Runs even when no pass reads its outputs this frame, for results kept across frames.
+    Pass& keep(bool bKeep = true);
+  };
+
+  // An executed pass of the last resolved frame.
+  struct PassResult
+  {
+    std::string name;
+    GLuint64 time;
+    // GL calls of the pass, including the barrier placed before it.
+    GLStats::Counters counters;
+  };
+
+protected:
+  struct Resource
+  {
+    std::string name;
+    // Barrier bits still needed before each kind of read of the last shader write.
+    GLbitfield pendingBarriers;
+  };
+
+  std::vector<Resource> m_resources;
+  std::deque<Pass> m_passes;
+  std::unordered_map<std::string, GLuint> m_queries;
+
+  // Results of the last resolved frame, in execution order.
+  std::vector<PassResult> m_results;
+  size_t m_numCulled;
+  size_t m_numBarriers;
+
+public:
+  FrameGraph();
+  ~FrameGraph();
+
+  // delete copy constructor
+  FrameGraph(const FrameGraph&) = delete;
+  FrameGraph& operator=(const FrameGraph&) = delete;
+
+  ResourceId addResource(const std::string& name);
+  Pass& addPass(const std::string& name, std::function<void()> execute);
+
+  void execute();
+  // Waits for this frame's timers and clears the passes for the next frame.
+  void resolve();
+
+  inline bool wasExecuted(const std::string& name) const { return findResult(name) != nullptr; }
+  GLuint64 getPassTime(const std::string& name) const;
+  GLuint64 getTotalTime() const;
+  inline const std::vector<PassResult>& getResults() const { return m_results; }
+  inline size_t numCulled() const { return m_numCulled; }
+  inline size_t numBarriers() const { return m_numBarriers; }
+
+protected:
+  void cull();
+  const PassResult* findResult(const std::string& name) const;
+};
+
+#endif // _FRAMEGRAPH_H
@@ -0,0 +1,112 @@
+#include "glstats.h"
+
+GLStats::Counters GLStats::s_current = {};
+GLStats::Counters GLStats::s_frame = {};
+
+#ifdef GL_STATS
+
+// Keeps glad's pointer and defines a wrapper that counts before forwarding to it.
+#define GLSTATS_WRAP(counter, type, name, params, args) \
+  static type s_##name = nullptr; \
+  static void APIENTRY counted_##name params \
+  { \
+    GLStats::count(GLStats::Counter::counter); \
+    s_##name args; \
+  }
+
+#define GLSTATS_INSTALL(name) \
+  if (glad_##name) \
+  { \
+    s_##name = glad_##name; \
+    glad_##name = counted_##name; \
+  }
+
+GLSTATS_WRAP(Draws, PFNGLDRAWARRAYSPROC, glDrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count))
+GLSTATS_WRAP(Draws, PFNGLDRAWARRAYSINDIRECTPROC, glDrawArraysIndirect, (GLenum mode, const void* indirect), (mode, indirect))
+GLSTATS_WRAP(Draws, PFNGLDRAWELEMENTSBASEVERTEXPROC, glDrawElementsBaseVertex,
+  (GLenum mode, GLsizei count, GLenum type, const void* indices, GLint basevertex), (mode, count, type, indices, basevertex))
+GLSTATS_WRAP(Draws, PFNGLDRAWELEMENTSINDIRECTPROC, glDrawElementsIndirect,
+  (GLenum mode, GLenum type, const void* indirect), (mode, type, indirect))
+GLSTATS_WRAP(Draws, PFNGLMULTIDRAWELEMENTSINDIRECTPROC, glMultiDrawElementsIndirect,
+  (GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride), (mode, type, indirect, drawcount, stride))
+
+GLSTATS_WRAP(Dispatches, PFNGLDISPATCHCOMPUTEPROC, glDispatchCompute,
+  (GLuint x, GLuint y, GLuint z), (x, y, z))
+
+GLSTATS_WRAP(ProgramBinds, PFNGLUSEPROGRAMPROC, glUseProgram, (GLuint program), (program))
+
+GLSTATS_WRAP(BufferBinds, PFNGLBINDBUFFERPROC, glBindBuffer, (GLenum target, GLuint buffer), (target, buffer))
+GLSTATS_WRAP(BufferBinds, PFNGLBINDBUFFERBASEPROC, glBindBufferBase,
+  (GLenum target, GLuint index, GLuint buffer), (target, index, buffer))
+GLSTATS_WRAP(BufferBinds, PFNGLBINDBUFFERRANGEPROC, glBindBufferRange,
+  (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size), (target, index, buffer, offset, size))
+GLSTATS_WRAP(BufferBinds, PFNGLBINDVERTEXARRAYPROC, glBindVertexArray, (GLuint array), (array))
+
+GLSTATS_WRAP(TextureBinds, PFNGLBINDTEXTUREPROC, glBindTexture, (GLenum target, GLuint texture), (target, texture))
+GLSTATS_WRAP(TextureBinds, PFNGLBINDTEXTUREUNITPROC, glBindTextureUnit, (GLuint unit, GLuint texture), (unit, texture))
+
+GLSTATS_WRAP(UniformUploads, PFNGLPROGRAMUNIFORM1IPROC, glProgramUniform1i,
+  (GLuint program, GLint location, GLint v0), (program, location, v0))
+GLSTATS_WRAP(UniformUploads, PFNGLPROGRAMUNIFORM1FPROC, glProgramUniform1f,
+  (GLuint program, GLint location, GLfloat v0), (program, location, v0))
+GLSTATS_WRAP(UniformUploads, PFNGLPROGRAMUNIFORM3FVPROC, glProgramUniform3fv,
+  (GLuint program, GLint location, GLsizei count, const GLfloat* value), (program, location, count, value))
+GLSTATS_WRAP(UniformUploads, PFNGLPROGRAMUNIFORMMATRIX4FVPROC, glProgramUniformMatrix4fv,
+  (GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (program, location, count, transpose, value))
+
+GLSTATS_WRAP(Barriers, PFNGLMEMORYBARRIERPROC, glMemoryBarrier, (GLbitfield barriers), (barriers))
+
+#endif // GL_STATS
+
+void GLStats::install()
+{
+#ifdef GL_STATS
+  GLSTATS_INSTALL(glDrawArrays);
+  GLSTATS_INSTALL(glDrawArraysIndirect);
+  GLSTATS_INSTALL(glDrawElementsBaseVertex);
+  GLSTATS_INSTALL(glDrawElementsIndirect);
+  GLSTATS_INSTALL(glMultiDrawElementsIndirect);
+
+  GLSTATS_INSTALL(glDispatchCompute);
+
+  GLSTATS_INSTALL(glUseProgram);
+
+  GLSTATS_INSTALL(glBindBuffer);
+  GLSTATS_INSTALL(glBindBufferBase);
+  GLSTATS_INSTALL(glBindBufferRange);
+  GLSTATS_INSTALL(glBindVertexArray);
+
+  GLSTATS_INSTALL(glBindTexture);
+  GLSTATS_INSTALL(glBindTextureUnit);
+
+  GLSTATS_INSTALL(glProgramUniform1i);
+  GLSTATS_INSTALL(glProgramUniform1f);
+  GLSTATS_INSTALL(glProgramUniform3fv);
+  GLSTATS_INSTALL(glProgramUniformMatrix4fv);
+
+  GLSTATS_INSTALL(glMemoryBarrier);
+#endif // GL_STATS
+}
+
+const char* GLStats::getName(Counter counter)
+{
+  switch (counter)
+  {
+  case Counter::Draws: return "Draws";
+  case Counter::Dispatches: return "Dispatches";
+  case Counter::ProgramBinds: return "Program binds";
+  case Counter::BufferBinds: return "Buffer binds";
+  case Counter::TextureBinds: return "Texture binds";
+  case Counter::UniformUploads: return "Uniform uploads";
+  case Counter::Barriers: return "Barriers";
+  default: return "";
+  }
+}
+
+GLStats::Counters GLStats::difference(const Counters& from, const Counters& to)
+{
+  Counters counters;
+  for (size_t i = 0; i < counters.size(); i++)
+    counters[i] = to[i] - from[i];
+  return counters;
+}
@@ -0,0 +1,57 @@
+#ifndef _GLSTATS_H
+#define _GLSTATS_H
+#include <glad/glad.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Count the GL calls that cost driver time, per frame and per frame graph pass.
+#define GL_STATS
+
+// Counts draws, dispatches, binds, uniform uploads and barriers by swapping glad's entry
+// points for counting wrappers, so every call site is covered without touching it.
+//
+// Counts are per context thread and only meaningful between beginFrame() and endFrame().
+// Without GL_STATS install() leaves the entry points alone and every count stays zero.
+class GLStats
+{
+public:
+  enum class Counter
+  {
+    Draws,
+    Dispatches,
+    ProgramBinds,
+    BufferBinds,
+    TextureBinds,
+    UniformUploads,
+    Barriers,
+
+    Max
+  };
+
+  typedef std::array<uint32_t, (size_t)Counter::Max> Counters;
+
+protected:
+  static Counters s_current;
+  static Counters s_frame;
+
+public:
+  // Call once after gladLoadGL.
+  static void install();
+
+  static const char* getName(Counter counter);
+
+  static inline void count(Counter counter) { s_current[(size_t)counter]++; }
+
+  static inline void beginFrame() { s_current = {}; }
+  static inline void endFrame() { s_frame = s_current; }
+
+  // Counts so far this frame, to difference around a span of calls.
+  static inline const Counters& current() { return s_current; }
+  // Counts of the last ended frame.
+  static inline const Counters& frame() { return s_frame; }
+
+  static Counters difference(const Counters& from, const Counters& to);
+};
+
+#endif // _GLSTATS_H
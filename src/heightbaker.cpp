@@ -0,0 +1,73 @@
+#include "heightbaker.h"
+#include "threadpool.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEIGHTBAKER_SSE2
+#include <emmintrin.h>
+#endif
+
+static const int BAKE_ROWS_PER_JOB = 16;
+
+static inline void bakeTexel(const float* above, const float* row, const float* below, int x, int xLeft, int xRight,
+  float scaleU, float scaleV, float* out)
+{
+  out[0] = row[x];
+  out[1] = (row[xRight] - row[xLeft]) * scaleU;
+  out[2] = (below[x] - above[x]) * scaleV;
+  out[3] = 1.0f;
+}
+
+static void bakeRow(const float* above, const float* row, const float* below, int width, float scaleU, float scaleV, float* out)
+{
+  // The first and last texel wrap around, everything in between reads its direct neighbours.
+  bakeTexel(above, row, below, 0, width - 1, std::min(1, width - 1), scaleU, scaleV, out);
+  if (width == 1)
+    return;
+
+  int x = 1;
+
+#ifdef HEIGHTBAKER_SSE2
+  const __m128 su = _mm_set1_ps(scaleU);
+  const __m128 sv = _mm_set1_ps(scaleV);
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (; x + 4 < width; x += 4)
+  {
+    __m128 h = _mm_loadu_ps(row + x);
+    __m128 du = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + x + 1), _mm_loadu_ps(row + x - 1)), su);
+    __m128 dv = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(below + x), _mm_loadu_ps(above + x)), sv);
+    __m128 w = one;
+
+    // Four planar vectors to four RGBA texels.
+    _MM_TRANSPOSE4_PS(h, du, dv, w);
+    _mm_storeu_ps(out + (size_t)x * 4, h);
+    _mm_storeu_ps(out + (size_t)(x + 1) * 4, du);
+    _mm_storeu_ps(out + (size_t)(x + 2) * 4, dv);
+    _mm_storeu_ps(out + (size_t)(x + 3) * 4, w);
+  }
+#endif // HEIGHTBAKER_SSE2
+
+  for (; x < width - 1; x++)
+    bakeTexel(above, row, below, x, x - 1, x + 1, scaleU, scaleV, out + (size_t)x * 4);
+
+  bakeTexel(above, row, below, width - 1, width - 2, 0, scaleU, scaleV, out + (size_t)(width - 1) * 4);
+}
+
+void HeightBaker::bake(const float* heights, int width, int height, float* out)
+{
+  // Neighbours are one texel apart, 1 / size in uv.
+  const float scaleU = width * 0.5f;
+  const float scaleV = height * 0.5f;
+  const size_t numJobs = (height + BAKE_ROWS_PER_JOB - 1) / BAKE_ROWS_PER_JOB;
+
+  ThreadPool::global().parallelFor(numJobs, [&](size_t iJob) {
+    int rowEnd = std::min(height, (int)(iJob + 1) * BAKE_ROWS_PER_JOB);
+    for (int y = (int)iJob * BAKE_ROWS_PER_JOB; y < rowEnd; y++)
+    {
+      const float* above = heights + (size_t)((y + height - 1) % height) * width;
+      const float* row = heights + (size_t)y * width;
+      const float* below = heights + (size_t)((y + 1) % height) * width;
+      bakeRow(above, row, below, width, scaleU, scaleV, out + (size_t)y * width * 4);
+    }
+  });
+}
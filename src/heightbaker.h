@@ -0,0 +1,18 @@
+#ifndef _HEIGHTBAKER_H
+#define _HEIGHTBAKER_H
+
+// Bakes a heightmap into height plus its uv-space derivatives, so displacement shaders get
+// the displaced position and the perturbed normal from a single fetch.
+//
+// Derivatives are central differences scaled to uv units, wrapping at the edges like the
+// GL_REPEAT sampling they feed. Rows are split across the thread pool and the inner loop
+// uses SSE2 where available.
+class HeightBaker
+{
+public:
+  // `heights` holds width * height values, `out` receives width * height RGBA texels of
+  // (height, dh/du, dh/dv, 1).
+  static void bake(const float* heights, int width, int height, float* out);
+};
+
+#endif // _HEIGHTBAKER_H
@@ -0,0 +1,39 @@
+#include "loadarena.h"
+
+ArenaCounter::ArenaCounter(std::pmr::memory_resource* upstream)
+  : m_upstream(upstream)
+  , m_bytes(0)
+  , m_peakBytes(0)
+  , m_numBlocks(0)
+{
+}
+
+void* ArenaCounter::do_allocate(size_t bytes, size_t alignment)
+{
+  void* p = m_upstream->allocate(bytes, alignment);
+
+  size_t current = m_bytes.fetch_add(bytes) + bytes;
+  size_t peak = m_peakBytes.load();
+  while (current > peak && !m_peakBytes.compare_exchange_weak(peak, current))
+    ;
+
+  m_numBlocks++;
+  return p;
+}
+
+void ArenaCounter::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+  m_upstream->deallocate(p, bytes, alignment);
+  m_bytes.fetch_sub(bytes);
+}
+
+bool ArenaCounter::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+  return this == &other;
+}
+
+LoadArena::LoadArena(ArenaCounter* counter, size_t initialSize)
+  : m_counter(counter ? counter : &m_ownCounter)
+  , m_buffer(initialSize, m_counter)
+{
+}
@@ -0,0 +1,60 @@
+#ifndef _LOADARENA_H
+#define _LOADARENA_H
+#include <memory_resource>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Upstream resource that counts the heap memory arenas draw. Thread-safe, so arenas on
+// several threads can report into one counter.
+class ArenaCounter : public std::pmr::memory_resource
+{
+protected:
+  std::pmr::memory_resource* m_upstream;
+  std::atomic<size_t> m_bytes;
+  std::atomic<size_t> m_peakBytes;
+  std::atomic<size_t> m_numBlocks;
+
+public:
+  ArenaCounter(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+  // delete copy constructor
+  ArenaCounter(const ArenaCounter&) = delete;
+  ArenaCounter& operator=(const ArenaCounter&) = delete;
+
+  inline size_t bytes() const { return m_bytes.load(); }
+  inline size_t peakBytes() const { return m_peakBytes.load(); }
+  inline size_t numBlocks() const { return m_numBlocks.load(); }
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+// Monotonic arena for load-time temporaries. Allocating is a pointer bump and nothing is
+// returned to the heap until release() or destruction. Not thread-safe: give each thread
+// its own arena, sharing a counter if the totals should add up.
+class LoadArena
+{
+protected:
+  ArenaCounter m_ownCounter;
+  ArenaCounter* m_counter;
+  std::pmr::monotonic_buffer_resource m_buffer;
+
+public:
+  explicit LoadArena(ArenaCounter* counter = nullptr, size_t initialSize = 64 * 1024);
+
+  // delete copy constructor
+  LoadArena(const LoadArena&) = delete;
+  LoadArena& operator=(const LoadArena&) = delete;
+
+  inline std::pmr::memory_resource* resource() { return &m_buffer; }
+  inline ArenaCounter& counter() { return *m_counter; }
+  inline const ArenaCounter& counter() const { return *m_counter; }
+
+  // Free everything allocated from the arena at once.
+  inline void release() { m_buffer.release(); }
+};
+
+#endif // _LOADARENA_H
@@ -3,10 +3,18 @@
 #include <iostream>
 #include <filesystem>
 #include <memory>
+#include <cstring>
 #include "mesh.h"
 #include "shader.h"
+#include "shaderpermutations.h"
 #include "texture.h"
+#include "texturestreamer.h"
+#include "texturemanager.h"
 #include "buffer.h"
+#include "frameconstants.h"
+#include "framegraph.h"
+#include "glstats.h"
+#include "assetloader.h"
 #include "statsobject.hpp"
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -63,6 +71,16 @@ enum class ThreadgroupSize : int
   Max
 };
 
+// Where fragment shaders get the barycentrics the wireframe is drawn from, the value of
+// BARYCENTRICS in simple.fs, textured.fs and parallax.fs.
+enum class Barycentrics : int
+{
+  None,
+  Interpolated,
+  NV,
+  AMD,
+};
+
 enum class SubdivLevel : int
 {
   Subdiv_2,
@@ -153,36 +171,72 @@ static GLuint getSubdivLevel(SubdivLevel level)
   return 0;
 }
 
-static std::unique_ptr<ShaderProgram> tilegen[(int)ClippingMode::Max][(int)NormalMode::Max][(int)ThreadgroupSize::Max];
-static std::unique_ptr<ShaderProgram>& getTilegenShader(ClippingMode clip, NormalMode normals, ThreadgroupSize threads)
-{
-  return tilegen[(int)clip][(int)normals][(int)threads];
-}
+// Indexed by clipping mode, normal mode and threadgroup size.
+static std::unique_ptr<ShaderPermutations> s_tilegenShaders;
 
 static std::unique_ptr<ShaderProgram> simpleMaterial;
 static std::unique_ptr<ShaderProgram> texturedMaterial;
+static std::unique_ptr<ShaderProgram> texturedMeshMaterial;
+static std::unique_ptr<ShaderProgram> texturedMeshBatchMaterial;
 
 static int s_subdivLevel = (int)SubdivLevel::Subdiv_64;
-static std::unique_ptr<ShaderProgram> subdivMaterials[(int)SubdivLevel::Count];
-static std::unique_ptr<ShaderProgram> texturedSubdivMaterials[(int)SubdivLevel::Count];
+// Indexed by textured, subdiv level and wireframe geometry shader.
+static std::unique_ptr<ShaderPermutations> s_subdivShaders;
+
+static int s_parallaxSteps = 32;
+static std::unique_ptr<ShaderProgram> parallaxMaterial;
+static std::unique_ptr<ShaderProgram> texturedParallaxMaterial;
 
 static std::unique_ptr<ShaderProgram> lineMaterial;
+
+// Wireframe variants for drivers without barycentric extensions: the generated mesh read
+// by vertex id, everything else through wireframe.gs.
+static std::unique_ptr<ShaderProgram> generatedWireMaterial;
+static std::unique_ptr<ShaderProgram> texturedGeneratedWireMaterial;
+static std::unique_ptr<ShaderProgram> texturedMeshWireMaterial;
+static std::unique_ptr<ShaderProgram> texturedMeshBatchWireMaterial;
+static std::unique_ptr<ShaderProgram> parallaxWireMaterial;
+static std::unique_ptr<ShaderProgram> texturedParallaxWireMaterial;
+
+static Barycentrics s_barycentricExtension = Barycentrics::None;
+
+// Uniforms set every frame, interned once instead of looked up by string per draw. Camera
+// and model constants live in the uniform ring instead.
+static const UniformId s_uDiffuse("diffuse");
+static const UniformId s_uTex("tex");
+static const UniformId s_uDisplacement("displacement");
+static const UniformId s_uParallaxSteps("parallaxSteps");
+static const UniformId s_uWireframe("wireframe");
 static std::unique_ptr<GPUMeshStreams> generatedMesh;
 
+// Storage bindings of the generated streams, for tilegen.glsl and vertex pulling.
+static const int GENERATED_VERTEX_BINDING = 3;
+static const int GENERATED_INDEX_BINDING = 4;
+
+// FrameConstants and DrawConstants for every program, one slot per frame in flight.
+static const size_t UNIFORM_RING_FRAME_SIZE = 64 * 1024;
+static std::unique_ptr<UniformBuffer> s_uniformRing;
+
+static std::unique_ptr<FrameGraph> s_frameGraph;
+static FrameGraph::ResourceId s_generatedVertices;
+static FrameGraph::ResourceId s_generatedIndices;
+static FrameGraph::ResourceId s_generatedDrawCommand;
+
 static std::unique_ptr<Mesh> s_sponza;
 static int s_curMeshTarget = (int)MeshTarget::Cube_2;
 static int s_curTilemesh = (int)TileMeshes::Brick;
 static std::vector<std::unique_ptr<TargetMesh>> s_meshTarget;
 static std::vector<std::unique_ptr<Mesh>> s_tessellationTarget;
 static std::vector<std::unique_ptr<TileMesh>> s_tileMeshes;
-static std::vector<std::unique_ptr<Texture>> s_tileDiffTextures;
-static std::vector<std::unique_ptr<Texture>> s_tileDispTextures;
+static std::vector<std::shared_ptr<Texture>> s_tileDiffTextures;
+static std::vector<std::shared_ptr<Texture>> s_tileDispTextures;
 
 //static std::unique_ptr<StorageBuffer> outputVertices;
 //static std::unique_ptr<StorageBuffer> outputIndices;
 
 static bool s_bDrawWireframe = false;
 static bool s_bDrawTessellatedMesh = true;
+static bool s_bDrawParallaxMesh = false;
 static bool s_bDrawNormalVectors = false;
 static bool s_bComputeReferenceImplementation = false;
 static bool s_bOneTimeCompute = false;
@@ -193,12 +247,11 @@ static bool s_bDrawReferenceImplementation = false;
 static int s_nTrianglesOnScreen = 0;
 static bool s_bTakeScreenshot = false;
 
+// Pass timers live in the frame graph.
 enum class GLQuery
 {
-  ComputeTime,
   TessellationTriangles,
-  TessellationRenderTime,
-  TilemeshRenderTime,
+  TilemeshTriangles,
 
   Max
 };
@@ -209,12 +262,11 @@ static double s_frameTimes[FRAMETIME_WINDOW] = { 0 };
 
 // Stats objects.
 static bool s_bRecordingFrametime = false;
-static StatsObject s_statsFrametime("frametime.csv", { "Compute", "Tesselation", "Render" });
+static std::vector<std::string> frametimeColumns(void);
+static StatsObject s_statsFrametime("frametime.csv", frametimeColumns());
 
 
-static std::unique_ptr<Mesh> loadMesh(const std::string& mesh);
-static std::unique_ptr<TargetMesh> loadTargetMesh(const std::string& mesh);
-static std::unique_ptr<TileMesh> loadTileMesh(const std::string& mesh);
+static std::string scenePath(const std::string& file);
 static void loadShaders(void);
 static void drawUI(GLFWwindow* window, double dt);
 static void updateInput(GLFWwindow* window, float dt);
@@ -224,6 +276,9 @@ static void saveScreenshot(GLFWwindow* window);
 static void generateSurfaceGeometry(const TargetMesh& target, const TileMesh& tile);
 static void drawScene(void);
 static void drawLines(Mesh* mesh);
+static void bindDrawConstants(const glm::mat4& model);
+static Barycentrics detectBarycentricExtension(void);
+static bool wireframeNeedsFallback(void);
 
 void glfwErrorCallback(int error, const char* description)
 {
@@ -263,6 +318,7 @@ int main()
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_SRGB_CAPABLE, true);
 
 #if _DEBUG
   glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
@@ -286,6 +342,11 @@ int main()
     return -1;
   }
 
+  ShaderProgram::initParallelCompile((GLADloadproc)glfwGetProcAddress);
+  GLStats::install();
+
+  s_barycentricExtension = detectBarycentricExtension();
+
   // Setup debug callback.
 #if _DEBUG
   int flags;
@@ -320,54 +381,56 @@ int main()
   ImGui_ImplGlfw_InitForOpenGL(window, true);
   ImGui_ImplOpenGL3_Init();
 
-  // Load shaders.
-  loadShaders();
-
   s_tileMeshes.resize((int)TileMeshes::Count);
   s_tileDiffTextures.resize((int)TileMeshes::Count);
   s_tileDispTextures.resize((int)TileMeshes::Count);
-
-  s_tileMeshes[(int)TileMeshes::Brick] = loadTileMesh("tile_brick.obj");
-  s_tileDiffTextures[(int)TileMeshes::Brick] = nullptr;
-  s_tileDispTextures[(int)TileMeshes::Brick] = std::make_unique<Texture>((std::filesystem::path(SCENE_DIR) / "brick.jpg").string());
-
-  s_tileMeshes[(int)TileMeshes::InsetCube] = loadTileMesh("cube_in_cube.obj");
-  s_tileDiffTextures[(int)TileMeshes::InsetCube] = nullptr;
-  s_tileDispTextures[(int)TileMeshes::InsetCube] = std::make_unique<Texture>((std::filesystem::path(SCENE_DIR) / "inset_cubes_heights.tga").string());
-
-  //s_tileMeshes[(int)TileMeshes::Sponza] = loadTileMesh("sponza_brick.obj");
-  s_tileMeshes[(int)TileMeshes::Sponza] = loadTileMesh("sponza_brick_2.obj");
-  s_tileDiffTextures[(int)TileMeshes::Sponza] = std::make_unique<Texture>((std::filesystem::path(SCENE_DIR) / "sponza/textures/spnza_bricks_a_diff.png").string());
-  s_tileDispTextures[(int)TileMeshes::Sponza] = std::make_unique<Texture>((std::filesystem::path(SCENE_DIR) / "sponza/textures/spnza_bricks_a_bump.png").string());
-
-  s_sponza = loadMesh("sponza/sponza_no_bricks_scaled.obj");
-
   s_meshTarget.resize((int)MeshTarget::Count);
-  s_meshTarget[(int)MeshTarget::Cube_Simple] = loadTargetMesh("cube_simple.obj");
-  s_meshTarget[(int)MeshTarget::Cube_1] = loadTargetMesh("cube_1.obj");
-  s_meshTarget[(int)MeshTarget::Cube_2] = loadTargetMesh("cube_2.obj");
-  s_meshTarget[(int)MeshTarget::Cube_3] = loadTargetMesh("cube_3.obj");
-  s_meshTarget[(int)MeshTarget::Cube_4] = loadTargetMesh("cube_4.obj");
-  s_meshTarget[(int)MeshTarget::Ico] = loadTargetMesh("test_ico.obj");
-  s_meshTarget[(int)MeshTarget::SmoothIco] = loadTargetMesh("smooth_ico.obj");
-  s_meshTarget[(int)MeshTarget::SmoothIco3] = loadTargetMesh("smooth_ico_x3.obj");
-  s_meshTarget[(int)MeshTarget::Cylinder] = loadTargetMesh("cylinder.obj");
-  s_meshTarget[(int)MeshTarget::SmoothCylinder] = loadTargetMesh("cylinder_smooth.obj");
-  s_meshTarget[(int)MeshTarget::Sponza] = loadTargetMesh("sponza/sponza_bricks_scaled.obj");
-
   s_tessellationTarget.resize((int)MeshTarget::Count);
-  s_tessellationTarget[(int)MeshTarget::Cube_Simple] = loadMesh("cube_simple.obj");
-  s_tessellationTarget[(int)MeshTarget::Cube_1] = loadMesh("cube_1.obj");
-  s_tessellationTarget[(int)MeshTarget::Cube_2] = loadMesh("cube_2.obj");
-  s_tessellationTarget[(int)MeshTarget::Cube_3] = loadMesh("cube_3.obj");
-  s_tessellationTarget[(int)MeshTarget::Cube_4] = loadMesh("cube_4.obj");
-  s_tessellationTarget[(int)MeshTarget::Ico] = loadMesh("test_ico.obj");
-  s_tessellationTarget[(int)MeshTarget::SmoothIco] = loadMesh("smooth_ico.obj");
-  s_tessellationTarget[(int)MeshTarget::SmoothIco3] = loadMesh("smooth_ico_x3.obj");
-  s_tessellationTarget[(int)MeshTarget::Cylinder] = loadMesh("cylinder.obj");
-  s_tessellationTarget[(int)MeshTarget::SmoothCylinder] = loadMesh("cylinder_smooth.obj");
-  s_tessellationTarget[(int)MeshTarget::Sponza] = loadMesh("sponza/sponza_bricks_scaled.obj");
 
+  // Parse and decode everything on the thread pool, create GL objects here as results arrive.
+  {
+    AssetLoader loader;
+
+    loader.loadTileMesh(scenePath("tile_brick.obj"), s_tileMeshes[(int)TileMeshes::Brick]);
+    s_tileDiffTextures[(int)TileMeshes::Brick] = nullptr;
+    loader.loadTexture(scenePath("brick.jpg"), s_tileDispTextures[(int)TileMeshes::Brick], TextureUsage::HeightDerivatives);
+
+    loader.loadTileMesh(scenePath("cube_in_cube.obj"), s_tileMeshes[(int)TileMeshes::InsetCube]);
+    s_tileDiffTextures[(int)TileMeshes::InsetCube] = nullptr;
+    loader.loadTexture(scenePath("inset_cubes_heights.tga"), s_tileDispTextures[(int)TileMeshes::InsetCube], TextureUsage::HeightDerivatives);
+
+    //loader.loadTileMesh(scenePath("sponza_brick.obj"), s_tileMeshes[(int)TileMeshes::Sponza]);
+    loader.loadTileMesh(scenePath("sponza_brick_2.obj"), s_tileMeshes[(int)TileMeshes::Sponza]);
+    loader.loadTexture(scenePath("sponza/textures/spnza_bricks_a_diff.png"), s_tileDiffTextures[(int)TileMeshes::Sponza], TextureUsage::Color, TextureCompression::Block);
+    loader.loadTexture(scenePath("sponza/textures/spnza_bricks_a_bump.png"), s_tileDispTextures[(int)TileMeshes::Sponza], TextureUsage::HeightDerivatives);
+
+    loader.loadMesh(scenePath("sponza/sponza_no_bricks_scaled.obj"), s_sponza);
+
+    const char* targetFiles[(int)MeshTarget::Count] = {
+      "cube_simple.obj",
+      "cube_1.obj",
+      "cube_2.obj",
+      "cube_3.obj",
+      "cube_4.obj",
+      "test_ico.obj",
+      "smooth_ico.obj",
+      "smooth_ico_x3.obj",
+      "cylinder.obj",
+      "cylinder_smooth.obj",
+      "sponza/sponza_bricks_scaled.obj",
+    };
+
+    for (int iTarget = 0; iTarget < (int)MeshTarget::Count; iTarget++)
+    {
+      loader.loadTargetMesh(scenePath(targetFiles[iTarget]), s_meshTarget[iTarget]);
+      loader.loadMesh(scenePath(targetFiles[iTarget]), s_tessellationTarget[iTarget]);
+    }
+
+    // Compile shaders while the pool works through the assets.
+    loadShaders();
+
+    loader.finish();
+  }
 
   const int maxVertices = 1024 * 128 * 128 * 4;
   const int maxIndices = 3 * maxVertices;
@@ -378,6 +441,13 @@ int main()
 
   glGenQueries((int)GLQuery::Max, s_glQueries);
 
+  s_uniformRing = std::make_unique<UniformBuffer>(UNIFORM_RING_FRAME_SIZE);
+
+  s_frameGraph = std::make_unique<FrameGraph>();
+  s_generatedVertices = s_frameGraph->addResource("generatedVertices");
+  s_generatedIndices = s_frameGraph->addResource("generatedIndices");
+  s_generatedDrawCommand = s_frameGraph->addResource("generatedDrawCommand");
+
   // Main loop.
   double lastTime = glfwGetTime();
   for (;;)
@@ -389,6 +459,10 @@ int main()
     double dt = time - lastTime;
     lastTime = time;
 
+    GLStats::beginFrame();
+
+    TextureStreamer::global().update();
+
     // UI
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -398,17 +472,19 @@ int main()
     updateCamera(window);
     updateInput(window, dt);
 
+    // Camera constants for every program this frame.
+    s_uniformRing->beginFrame();
+    FrameConstants frameConstants = { viewProj, glm::vec4(cameraPos, 1.f) };
+    GLintptr frameConstantsOffset = s_uniformRing->allocate(&frameConstants, sizeof(frameConstants));
+    if (frameConstantsOffset >= 0)
+      s_uniformRing->bindRange(FrameConstants::BINDING, frameConstantsOffset, sizeof(frameConstants));
+
     glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (s_bDrawWireframe)
-    {
-      glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    }
-    else
-    {
-      glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    }
+    // Color textures are sampled as linear, write the scene back out as sRGB. The clear
+    // color and the UI are authored in sRGB and stay unconverted.
+    glEnable(GL_FRAMEBUFFER_SRGB);
 
     TargetMesh* curTarget = nullptr;
     Mesh* tessellateMesh = nullptr;
@@ -428,95 +504,153 @@ int main()
       tileDispTex = s_tileDispTextures[s_curTilemesh].get();
     }
 
-    // Compute phase.
-    glBeginQuery(GL_TIME_ELAPSED, s_glQueries[(int)GLQuery::ComputeTime]);
+    // Passes run in the order added; the graph drops those nothing visible depends on and
+    // places the barriers between them.
+    FrameGraph& graph = *s_frameGraph;
+
     if ((s_bComputeReferenceImplementation || s_bOneTimeCompute) && curTarget && curTile)
     {
-      generateSurfaceGeometry(*curTarget, *curTile);
-      s_bOneTimeCompute = false;
+      // A one-time result is kept for later frames even when it is not drawn in this one.
+      graph.addPass("Tilegen", [&]() {
+        generateSurfaceGeometry(*curTarget, *curTile);
+        s_bOneTimeCompute = false;
+      })
+        .uses(s_generatedVertices, FrameGraph::Access::TransferWrite)
+        .uses(s_generatedIndices, FrameGraph::Access::TransferWrite)
+        .uses(s_generatedVertices, FrameGraph::Access::StorageWrite)
+        .uses(s_generatedIndices, FrameGraph::Access::StorageWrite)
+        .keep(s_bOneTimeCompute);
     }
-    glEndQuery(GL_TIME_ELAPSED);
 
-    const ShaderProgram* curSubdivMaterial = tileDiffTex ? texturedSubdivMaterials[s_subdivLevel].get() : subdivMaterials[s_subdivLevel].get();
-    if (curSubdivMaterial)
+    const ShaderProgram* curSubdivMaterial = s_subdivShaders->get({ tileDiffTex ? 1 : 0, s_subdivLevel, wireframeNeedsFallback() ? 1 : 0 });
+    if (curSubdivMaterial && s_bDrawTessellatedMesh && tessellateMesh)
     {
-      curSubdivMaterial->bind();
+      graph.addPass("Tessellation", [&]() {
+        curSubdivMaterial->bind();
 
-      // Set uniforms.
-      glm::mat4 model(1.f);
-      glUniformMatrix4fv(curSubdivMaterial->getUniformLocation("viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
-      glUniformMatrix4fv(curSubdivMaterial->getUniformLocation("model"), 1, GL_FALSE, glm::value_ptr(model));
-      glUniform3fv(curSubdivMaterial->getUniformLocation("viewPos"), 1, glm::value_ptr(cameraPos));
+        // Set uniforms.
+        bindDrawConstants(glm::mat4(1.f));
 
-      glUniform1i(curSubdivMaterial->getUniformLocation("diffuse"), 0);
-      if (tileDiffTex)
-      {
-        glActiveTexture(GL_TEXTURE0);
-        tileDiffTex->bind();
-      }
+        curSubdivMaterial->setUniform(s_uWireframe, s_bDrawWireframe ? 1 : 0);
 
-      glUniform1i(curSubdivMaterial->getUniformLocation("displacement"), 1);
-      if (tileDispTex)
-      {
-        glActiveTexture(GL_TEXTURE1);
-        tileDispTex->bind();
-      }
+        curSubdivMaterial->setUniform(s_uDiffuse, 0);
+        if (tileDiffTex)
+        {
+          glActiveTexture(GL_TEXTURE0);
+          tileDiffTex->bind();
+        }
 
-      glBeginQuery(GL_TIME_ELAPSED, s_glQueries[(int)GLQuery::TessellationRenderTime]);
-      glBeginQuery(GL_PRIMITIVES_GENERATED, s_glQueries[(int)GLQuery::TessellationTriangles]);
-      if (s_bDrawTessellatedMesh && tessellateMesh)
-      {
+        curSubdivMaterial->setUniform(s_uDisplacement, 1);
+        if (tileDispTex)
+        {
+          glActiveTexture(GL_TEXTURE1);
+          tileDispTex->bind();
+        }
+
+        glBeginQuery(GL_PRIMITIVES_GENERATED, s_glQueries[(int)GLQuery::TessellationTriangles]);
         tessellateMesh->drawPatches();
-      }
-      glEndQuery(GL_TIME_ELAPSED);
-      glEndQuery(GL_PRIMITIVES_GENERATED);
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+      })
+        .uses(FrameGraph::BACKBUFFER, FrameGraph::Access::RenderTarget);
     }
 
-    drawScene();
-
-    if (s_bDrawNormalVectors && tessellateMesh)
+    // The untessellated mesh with the same displacement, ray marched per fragment.
+    const ShaderProgram* curParallaxMaterial = nullptr;
+    if (wireframeNeedsFallback())
+      curParallaxMaterial = tileDiffTex ? texturedParallaxWireMaterial.get() : parallaxWireMaterial.get();
+    else
+      curParallaxMaterial = tileDiffTex ? texturedParallaxMaterial.get() : parallaxMaterial.get();
+    if (curParallaxMaterial && s_bDrawParallaxMesh && tessellateMesh)
     {
-      drawLines(tessellateMesh);
+      graph.addPass("Parallax", [&]() {
+        curParallaxMaterial->bind();
+
+        bindDrawConstants(glm::mat4(1.f));
+        curParallaxMaterial->setUniform(s_uParallaxSteps, s_parallaxSteps);
+        curParallaxMaterial->setUniform(s_uWireframe, s_bDrawWireframe ? 1 : 0);
+
+        curParallaxMaterial->setUniform(s_uTex, 0);
+        if (tileDiffTex)
+        {
+          glActiveTexture(GL_TEXTURE0);
+          tileDiffTex->bind();
+        }
+
+        curParallaxMaterial->setUniform(s_uDisplacement, 1);
+        if (tileDispTex)
+        {
+          glActiveTexture(GL_TEXTURE1);
+          tileDispTex->bind();
+        }
+
+        // The tile's textures replace the target's own materials.
+        tessellateMesh->drawGeometry();
+      })
+        .uses(FrameGraph::BACKBUFFER, FrameGraph::Access::RenderTarget);
     }
 
-    ShaderProgram* generatedTileMat = tileDiffTex ? texturedMaterial.get() : simpleMaterial.get();
-
-    if (generatedTileMat)
+    if (s_curMeshTarget == (int)MeshTarget::Sponza)
     {
-      generatedTileMat->bind();
-
-      // Set uniforms.
-      glUniformMatrix4fv(generatedTileMat->getUniformLocation("viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
-      glUniform3fv(generatedTileMat->getUniformLocation("viewPos"), 1, glm::value_ptr(cameraPos));
-
-      glUniform1i(generatedTileMat->getUniformLocation("tex"), 0);
-      if (tileDiffTex)
-      {
-        glActiveTexture(GL_TEXTURE0);
-        tileDiffTex->bind();
-      }
-
-      glm::mat4 model = glm::mat4(1.f);
-      glUniformMatrix4fv(generatedTileMat->getUniformLocation("model"), 1, GL_FALSE, glm::value_ptr(model));
+      graph.addPass("Scene", []() { drawScene(); })
+        .uses(FrameGraph::BACKBUFFER, FrameGraph::Access::RenderTarget);
+    }
 
-      // TODO: send this indirectly!
-      GLuint numGenerated = generatedMesh->getNumGeneratedElements();
+    if (s_bDrawNormalVectors && tessellateMesh)
+    {
+      graph.addPass("NormalLines", [&]() { drawLines(tessellateMesh); })
+        .uses(FrameGraph::BACKBUFFER, FrameGraph::Access::RenderTarget);
+    }
 
-      // Render the generated mesh.
-      glBeginQuery(GL_TIME_ELAPSED, s_glQueries[(int)GLQuery::TilemeshRenderTime]);
-      if (s_bDrawReferenceImplementation && curTarget && curTile)
-      {
-        int numSurfaceTris = curTarget->numTriangles();
-        int maxSurfaceIndices = curTile->getNumIndices() * 4 * numSurfaceTris;
+    // The generated index count goes into the draw command on the GPU, no readback.
+    graph.addPass("GeneratedDrawCommand", []() { generatedMesh->updateDrawCommand(); })
+      .uses(s_generatedIndices, FrameGraph::Access::TransferRead)
+      .uses(s_generatedDrawCommand, FrameGraph::Access::TransferWrite);
+
+    // In wireframe without fragment barycentrics the generated mesh is pulled by vertex id,
+    // so every triangle corner can carry its own barycentric.
+    const bool bPullGenerated = wireframeNeedsFallback();
+    ShaderProgram* generatedTileMat = nullptr;
+    if (bPullGenerated)
+      generatedTileMat = tileDiffTex ? texturedGeneratedWireMaterial.get() : generatedWireMaterial.get();
+    else
+      generatedTileMat = tileDiffTex ? texturedMaterial.get() : simpleMaterial.get();
 
-        //generatedMesh->draw(maxSurfaceIndices);
-        generatedMesh->draw(numGenerated);
-      }
-      glEndQuery(GL_TIME_ELAPSED);
+    if (generatedTileMat && s_bDrawReferenceImplementation && curTarget && curTile)
+    {
+      graph.addPass("GeneratedMesh", [&]() {
+        generatedTileMat->bind();
+
+        // Set uniforms.
+        generatedTileMat->setUniform(s_uWireframe, s_bDrawWireframe ? 1 : 0);
+        generatedTileMat->setUniform(s_uTex, 0);
+        if (tileDiffTex)
+        {
+          glActiveTexture(GL_TEXTURE0);
+          tileDiffTex->bind();
+        }
+
+        bindDrawConstants(glm::mat4(1.f));
+
+        // Render the generated mesh.
+        glBeginQuery(GL_PRIMITIVES_GENERATED, s_glQueries[(int)GLQuery::TilemeshTriangles]);
+        if (bPullGenerated)
+          generatedMesh->drawPulled(GENERATED_VERTEX_BINDING, GENERATED_INDEX_BINDING);
+        else
+          generatedMesh->draw();
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+      })
+        .uses(s_generatedVertices, bPullGenerated ? FrameGraph::Access::StorageRead : FrameGraph::Access::VertexRead)
+        .uses(s_generatedIndices, bPullGenerated ? FrameGraph::Access::StorageRead : FrameGraph::Access::IndexRead)
+        .uses(s_generatedDrawCommand, FrameGraph::Access::IndirectRead)
+        .uses(FrameGraph::BACKBUFFER, FrameGraph::Access::RenderTarget);
     }
 
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    graph.execute();
+    GLStats::endFrame();
+
+    glDisable(GL_FRAMEBUFFER_SRGB);
 
+    s_uniformRing->endFrame();
 
     ImGui::Render();
 
@@ -526,17 +660,19 @@ int main()
     }
 
     // Analyze framedata.
-    GLuint64 computeTime = 0;
+    graph.resolve();
+    GLuint64 computeTime = graph.getPassTime("Tilegen");
+    GLuint64 tesselationRenderTime = graph.getPassTime("Tessellation");
+    GLuint64 tilemeshRenderTime = graph.getPassTime("GeneratedMesh");
+    GLuint64 parallaxRenderTime = graph.getPassTime("Parallax");
     GLuint64 tesselationTris = 0;
-    GLuint64 tesselationRenderTime = 0;
-    GLuint64 tilemeshRenderTime = 0;
-    glGetQueryObjectui64v(s_glQueries[(int)GLQuery::ComputeTime], GL_QUERY_RESULT, &computeTime);
-    glGetQueryObjectui64v(s_glQueries[(int)GLQuery::TessellationTriangles], GL_QUERY_RESULT, &tesselationTris);
-    glGetQueryObjectui64v(s_glQueries[(int)GLQuery::TessellationRenderTime], GL_QUERY_RESULT, &tesselationRenderTime);
-    glGetQueryObjectui64v(s_glQueries[(int)GLQuery::TilemeshRenderTime], GL_QUERY_RESULT, &tilemeshRenderTime);
+    GLuint64 tilemeshTris = 0;
+    if (graph.wasExecuted("Tessellation"))
+      glGetQueryObjectui64v(s_glQueries[(int)GLQuery::TessellationTriangles], GL_QUERY_RESULT, &tesselationTris);
+    if (graph.wasExecuted("GeneratedMesh"))
+      glGetQueryObjectui64v(s_glQueries[(int)GLQuery::TilemeshTriangles], GL_QUERY_RESULT, &tilemeshTris);
 
-
-    GLuint64 totalTime = computeTime + tesselationRenderTime + tilemeshRenderTime;
+    GLuint64 totalTime = graph.getTotalTime();
 
     // Shift frametime over.
     for (int i = 0; i < IM_ARRAYSIZE(s_frameTimes) - 1; i++)
@@ -546,20 +682,20 @@ int main()
     s_frameTimes[IM_ARRAYSIZE(s_frameTimes) - 1] = (double)totalTime * 1e-9;
     if (s_bRecordingFrametime)
     {
-      s_statsFrametime.AddData({ std::to_string(computeTime), std::to_string(tesselationRenderTime), std::to_string(tilemeshRenderTime) });
+      std::vector<std::string> row = { std::to_string(computeTime), std::to_string(tesselationRenderTime), std::to_string(tilemeshRenderTime), std::to_string(parallaxRenderTime) };
+#ifdef GL_STATS
+      for (uint32_t count : GLStats::frame())
+        row.push_back(std::to_string(count));
+#endif // GL_STATS
+      s_statsFrametime.AddData(row);
     }
 
-    s_nTrianglesOnScreen = 0;
-    if (s_bDrawReferenceImplementation)
-    {
-      s_nTrianglesOnScreen += generatedMesh->getNumGeneratedElements() / 3;
-    }
-    if (s_bDrawTessellatedMesh)
+    s_nTrianglesOnScreen = (int)(tesselationTris + tilemeshTris);
+    if (graph.wasExecuted("Parallax"))
     {
-      s_nTrianglesOnScreen += tesselationTris;
+      s_nTrianglesOnScreen += tessellateMesh->getTotalElements() / 3;
     }
 
-
     if (s_bTakeScreenshot)
     {
       s_bTakeScreenshot = false;
@@ -572,6 +708,11 @@ int main()
 
   glDeleteQueries((int)GLQuery::Max, s_glQueries);
 
+  s_uniformRing.reset();
+  s_frameGraph.reset();
+
+  TextureStreamer::global().shutdown();
+
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
 
@@ -589,9 +730,16 @@ static void generateSurfaceGeometry(const TargetMesh& target, const TileMesh& ti
   target.bindGeometryStream(0);
   tile.bindGeometryStreams(1, 2);
 
-  generatedMesh->bind(3, 4);
+  generatedMesh->bind(GENERATED_VERTEX_BINDING, GENERATED_INDEX_BINDING);
+
+  // A variant still compiling falls back to one with another threadgroup size, size the
+  // dispatch for the variant actually bound.
+  int used[3];
+  s_tilegenShaders->get({ (int)(s_bEnableClipping ? ClippingMode::On : ClippingMode::Off)
+    , (int)(s_bSmoothNormals ? NormalMode::Smooth : NormalMode::Flat)
+    , (int)s_threadgroupSize }, used)->bind();
 
-  const int threadgroupSize = getThreadgroupSize(s_threadgroupSize);
+  const int threadgroupSize = getThreadgroupSize((ThreadgroupSize)used[2]);
   // Run the compute shader.
   int numThreads = target.numTriangles() * (tile.getNumIndices() / 3);
   int numWorkgroupsX = (numThreads + (threadgroupSize - 1)) / threadgroupSize;
@@ -599,15 +747,11 @@ static void generateSurfaceGeometry(const TargetMesh& target, const TileMesh& ti
   //int numWorkgroupsX = tile.getNumIndices() / 3;
   //int numWorkgroupsY = target.numTriangles();
 
-  getTilegenShader(s_bEnableClipping ? ClippingMode::On : ClippingMode::Off
-    , s_bSmoothNormals ? NormalMode::Smooth : NormalMode::Flat
-    , s_threadgroupSize)->bind();
-
   glDispatchCompute(numWorkgroupsX, 1, 1);
 
   // Unbind mesh streams.
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, 0);
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, 0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GENERATED_VERTEX_BINDING, 0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GENERATED_INDEX_BINDING, 0);
 }
 
 static void drawScene(void)
@@ -615,16 +759,21 @@ static void drawScene(void)
   if (s_curMeshTarget != (int)MeshTarget::Sponza)
     return;
 
-  texturedMaterial->bind();
+  // Once its textures are packed into arrays the mesh draws in one call.
+  const bool bBatched = s_sponza && s_sponza->updateMaterials();
+  const ShaderProgram* material = nullptr;
+  if (wireframeNeedsFallback())
+    material = bBatched ? texturedMeshBatchWireMaterial.get() : texturedMeshWireMaterial.get();
+  else
+    material = bBatched ? texturedMeshBatchMaterial.get() : texturedMeshMaterial.get();
+  material->bind();
+  material->setUniform(s_uWireframe, s_bDrawWireframe ? 1 : 0);
   //simpleMaterial->bind();
 
   // Set uniforms.
-  glUniformMatrix4fv(texturedMaterial->getUniformLocation("viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
-  glUniform3fv(texturedMaterial->getUniformLocation("viewPos"), 1, glm::value_ptr(cameraPos));
-
   //glm::mat4 model = glm::scale(glm::mat4(1.f), glm::vec3(0.01f, 0.01f, 0.01f));
   glm::mat4 model = glm::mat4(1.f);
-  glUniformMatrix4fv(texturedMaterial->getUniformLocation("model"), 1, GL_FALSE, glm::value_ptr(model));
+  bindDrawConstants(model);
 
   if (s_sponza)
   {
@@ -637,32 +786,82 @@ static void drawLines(Mesh* mesh)
   lineMaterial->bind();
 
   // Set uniforms.
-  glUniformMatrix4fv(lineMaterial->getUniformLocation("viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
-  glUniform3fv(lineMaterial->getUniformLocation("viewPos"), 1, glm::value_ptr(cameraPos));
-
   glm::mat4 model = glm::mat4(1.f);
-  glUniformMatrix4fv(lineMaterial->getUniformLocation("model"), 1, GL_FALSE, glm::value_ptr(model));
+  bindDrawConstants(model);
 
 
   mesh->drawNormalVectors();
 }
 
-static std::unique_ptr<Mesh> loadMesh(const std::string& mesh)
+// Per-draw constants come out of this frame's ring slot, nothing is uploaded separately.
+static void bindDrawConstants(const glm::mat4& model)
 {
-  std::filesystem::path meshPath = std::filesystem::path(SCENE_DIR) / mesh;
-  return std::make_unique<Mesh>(meshPath.string());
+  DrawConstants drawConstants = { model };
+  GLintptr offset = s_uniformRing->allocate(&drawConstants, sizeof(drawConstants));
+  if (offset >= 0)
+    s_uniformRing->bindRange(DrawConstants::BINDING, offset, sizeof(drawConstants));
 }
 
-static std::unique_ptr<TargetMesh> loadTargetMesh(const std::string& mesh)
+static std::vector<std::string> frametimeColumns(void)
 {
-  std::filesystem::path meshPath = std::filesystem::path(SCENE_DIR) / mesh;
-  return std::make_unique<TargetMesh>(meshPath.string());
+  std::vector<std::string> columns = { "Compute", "Tesselation", "Render", "Parallax" };
+#ifdef GL_STATS
+  for (size_t i = 0; i < (size_t)GLStats::Counter::Max; i++)
+    columns.push_back(GLStats::getName((GLStats::Counter)i));
+#endif // GL_STATS
+  return columns;
 }
 
-static std::unique_ptr<TileMesh> loadTileMesh(const std::string& mesh)
+static std::string scenePath(const std::string& file)
 {
-  std::filesystem::path meshPath = std::filesystem::path(SCENE_DIR) / mesh;
-  return std::make_unique<TileMesh>(meshPath.string());
+  return (std::filesystem::path(SCENE_DIR) / file).string();
+}
+
+// Defines matching the static mesh vertex layout selected in mesh.h.
+static void addVertexFormatDefines(Shader::DefinesList& defines)
+{
+#ifdef COMPACT_VERTEX_FORMAT
+  defines.push_back({ "COMPACT_VERTEX_FORMAT", "1" });
+#endif // COMPACT_VERTEX_FORMAT
+
+#ifdef QUANTIZED_POSITIONS
+  defines.push_back({ "QUANTIZED_POSITIONS", "1" });
+#endif // QUANTIZED_POSITIONS
+}
+
+static void addBarycentricDefines(Shader::DefinesList& defines, Barycentrics barycentrics)
+{
+  defines.push_back({ "BARYCENTRICS", std::to_string((int)barycentrics) });
+}
+
+static Barycentrics detectBarycentricExtension(void)
+{
+  Barycentrics found = Barycentrics::None;
+
+  GLint numExtensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+  for (GLint i = 0; i < numExtensions; i++)
+  {
+    const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+    if (!name)
+      continue;
+
+    if (strcmp(name, "GL_NV_fragment_shader_barycentric") == 0)
+      return Barycentrics::NV;
+    if (strcmp(name, "GL_AMD_shader_explicit_vertex_parameter") == 0)
+      found = Barycentrics::AMD;
+  }
+
+  if (found == Barycentrics::None)
+    std::cout << "detectBarycentricExtension> No fragment barycentrics, wireframe uses a geometry shader and vertex pulling.\n";
+
+  return found;
+}
+
+// Without barycentrics from the driver the wireframe needs its own program variants.
+static bool wireframeNeedsFallback(void)
+{
+  return s_bDrawWireframe && s_barycentricExtension == Barycentrics::None;
 }
 
 static void loadShaders(void)
@@ -672,68 +871,184 @@ static void loadShaders(void)
     std::filesystem::path fragPath = std::filesystem::path(SHADERS_DIR) / "simple.fs";
     std::filesystem::path texturedFragPath = std::filesystem::path(SHADERS_DIR) / "textured.fs";
 
-    std::filesystem::path subdivVertPath = std::filesystem::path(SHADERS_DIR) / "subdiv.vs";
-    std::filesystem::path tcsPath = std::filesystem::path(SHADERS_DIR) / "subdiv.tcs";
-    std::filesystem::path tevPath = std::filesystem::path(SHADERS_DIR) / "subdiv.tev";
+    std::filesystem::path parallaxVertPath = std::filesystem::path(SHADERS_DIR) / "parallax.vs";
+    std::filesystem::path parallaxFragPath = std::filesystem::path(SHADERS_DIR) / "parallax.fs";
     std::filesystem::path lineVertPath = std::filesystem::path(SHADERS_DIR) / "line.vs";
     std::filesystem::path lineFragPath = std::filesystem::path(SHADERS_DIR) / "line.fs";
 
+    // Fragment shaders draw the wireframe from the driver's barycentrics where it has them.
+    Shader::DefinesList fragDefines;
+    addBarycentricDefines(fragDefines, s_barycentricExtension);
+
     // these are destructed when the function exits.
     Shader vert(GL_VERTEX_SHADER, vertPath.string());
-    Shader frag(GL_FRAGMENT_SHADER, fragPath.string());
+    Shader frag(GL_FRAGMENT_SHADER, fragPath.string(), fragDefines);
 
     std::vector<Shader*> progs = { &vert, &frag };
     simpleMaterial = std::make_unique<ShaderProgram>(progs);
 
-    Shader subdivVert(GL_VERTEX_SHADER, subdivVertPath.string());
-    Shader tev(GL_TESS_EVALUATION_SHADER, tevPath.string());
+    // Static meshes use the mesh vertex layout, the generated tile mesh stays float.
+    Shader::DefinesList meshDefines;
+    addVertexFormatDefines(meshDefines);
+
+    Shader meshVert(GL_VERTEX_SHADER, vertPath.string(), meshDefines);
 
     Shader lineVs(GL_VERTEX_SHADER, lineVertPath.string());
     Shader lineFs(GL_FRAGMENT_SHADER, lineFragPath.string());
 
-    Shader texturedFrag(GL_FRAGMENT_SHADER, texturedFragPath.string());
+    Shader texturedFrag(GL_FRAGMENT_SHADER, texturedFragPath.string(), fragDefines);
 
     progs = { &vert, &texturedFrag };
     texturedMaterial = std::make_unique<ShaderProgram>(progs);
 
-    progs = { &lineVs, &lineFs };
-    lineMaterial = std::make_unique<ShaderProgram>(progs);
+    progs = { &meshVert, &texturedFrag };
+    texturedMeshMaterial = std::make_unique<ShaderProgram>(progs);
 
-    for (int iSubdivLevel = 0; iSubdivLevel < (int)SubdivLevel::Count; ++iSubdivLevel)
-    {
-      Shader::DefinesList defines;
+    // Batched meshes read their materials through gl_DrawID.
+    Shader::DefinesList batchDefines = meshDefines;
+    batchDefines.push_back({ "MATERIAL_ARRAYS", "1" });
+    batchDefines.push_back({ "MATERIAL_BINDING", std::to_string(MaterialArrays::MATERIAL_BINDING) });
+    batchDefines.push_back({ "MAX_MATERIAL_ARRAYS", std::to_string(MaterialArrays::MAX_ARRAYS) });
 
-      defines.push_back({ "TESS_LEVEL", std::to_string(getSubdivLevel((SubdivLevel)iSubdivLevel)) });
+    Shader::DefinesList batchFragDefines = batchDefines;
+    addBarycentricDefines(batchFragDefines, s_barycentricExtension);
 
-      Shader tcs(GL_TESS_CONTROL_SHADER, tcsPath.string(), defines);
+    Shader batchVert(GL_VERTEX_SHADER, vertPath.string(), batchDefines);
+    Shader batchFrag(GL_FRAGMENT_SHADER, texturedFragPath.string(), batchFragDefines);
+
+    progs = { &batchVert, &batchFrag };
+    texturedMeshBatchMaterial = std::make_unique<ShaderProgram>(progs);
 
-      progs = { &subdivVert, &tcs, &tev, &frag };
-      subdivMaterials[iSubdivLevel] = std::make_unique<ShaderProgram>(progs);
+    Shader parallaxVert(GL_VERTEX_SHADER, parallaxVertPath.string(), meshDefines);
+    Shader parallaxFrag(GL_FRAGMENT_SHADER, parallaxFragPath.string(), fragDefines);
 
-      progs = { &subdivVert, &tcs, &tev, &texturedFrag };
-      texturedSubdivMaterials[iSubdivLevel] = std::make_unique<ShaderProgram>(progs);
+    Shader::DefinesList parallaxTexturedDefines = { { "DIFFUSE_TEXTURE", "1" } };
+    addBarycentricDefines(parallaxTexturedDefines, s_barycentricExtension);
+    Shader texturedParallaxFrag(GL_FRAGMENT_SHADER, parallaxFragPath.string(), parallaxTexturedDefines);
+
+    progs = { &parallaxVert, &parallaxFrag };
+    parallaxMaterial = std::make_unique<ShaderProgram>(progs);
+
+    progs = { &parallaxVert, &texturedParallaxFrag };
+    texturedParallaxMaterial = std::make_unique<ShaderProgram>(progs);
+
+    progs = { &lineVs, &lineFs };
+    lineMaterial = std::make_unique<ShaderProgram>(progs);
+
+    if (s_barycentricExtension == Barycentrics::None)
+    {
+      Shader::DefinesList pullingDefines = { { "VERTEX_PULLING", "1" } };
+      pullingDefines.push_back({ "GENERATED_VERTEX_BINDING", std::to_string(GENERATED_VERTEX_BINDING) });
+      pullingDefines.push_back({ "GENERATED_INDEX_BINDING", std::to_string(GENERATED_INDEX_BINDING) });
+
+      Shader::DefinesList interpolatedDefines;
+      addBarycentricDefines(interpolatedDefines, Barycentrics::Interpolated);
+
+      Shader pullingVert(GL_VERTEX_SHADER, vertPath.string(), pullingDefines);
+      Shader wireFrag(GL_FRAGMENT_SHADER, fragPath.string(), interpolatedDefines);
+      Shader texturedWireFrag(GL_FRAGMENT_SHADER, texturedFragPath.string(), interpolatedDefines);
+
+      progs = { &pullingVert, &wireFrag };
+      generatedWireMaterial = std::make_unique<ShaderProgram>(progs);
+
+      progs = { &pullingVert, &texturedWireFrag };
+      texturedGeneratedWireMaterial = std::make_unique<ShaderProgram>(progs);
+
+      // Static meshes get their barycentrics from a pass-through geometry shader.
+      std::filesystem::path gsPath = std::filesystem::path(SHADERS_DIR) / "wireframe.gs";
+      Shader::DefinesList wireGeometryDefines = { { "WIREFRAME_GEOMETRY", "1" } };
+
+      Shader::DefinesList meshWireDefines = meshDefines;
+      meshWireDefines.insert(meshWireDefines.end(), wireGeometryDefines.begin(), wireGeometryDefines.end());
+      Shader meshWireVert(GL_VERTEX_SHADER, vertPath.string(), meshWireDefines);
+      Shader meshWireGeom(GL_GEOMETRY_SHADER, gsPath.string());
+
+      progs = { &meshWireVert, &meshWireGeom, &texturedWireFrag };
+      texturedMeshWireMaterial = std::make_unique<ShaderProgram>(progs);
+
+      Shader::DefinesList batchWireDefines = batchDefines;
+      batchWireDefines.insert(batchWireDefines.end(), wireGeometryDefines.begin(), wireGeometryDefines.end());
+      Shader::DefinesList batchWireFragDefines = batchDefines;
+      addBarycentricDefines(batchWireFragDefines, Barycentrics::Interpolated);
+      Shader batchWireVert(GL_VERTEX_SHADER, vertPath.string(), batchWireDefines);
+      Shader batchWireGeom(GL_GEOMETRY_SHADER, gsPath.string(), batchDefines);
+      Shader batchWireFrag(GL_FRAGMENT_SHADER, texturedFragPath.string(), batchWireFragDefines);
+
+      progs = { &batchWireVert, &batchWireGeom, &batchWireFrag };
+      texturedMeshBatchWireMaterial = std::make_unique<ShaderProgram>(progs);
+
+      Shader::DefinesList parallaxWireGeomDefines = { { "FRAG_TANGENT", "1" } };
+      Shader::DefinesList texturedParallaxWireFragDefines = { { "DIFFUSE_TEXTURE", "1" } };
+      addBarycentricDefines(texturedParallaxWireFragDefines, Barycentrics::Interpolated);
+      Shader parallaxWireVert(GL_VERTEX_SHADER, parallaxVertPath.string(), meshWireDefines);
+      Shader parallaxWireGeom(GL_GEOMETRY_SHADER, gsPath.string(), parallaxWireGeomDefines);
+      Shader parallaxWireFrag(GL_FRAGMENT_SHADER, parallaxFragPath.string(), interpolatedDefines);
+      Shader texturedParallaxWireFrag(GL_FRAGMENT_SHADER, parallaxFragPath.string(), texturedParallaxWireFragDefines);
+
+      progs = { &parallaxWireVert, &parallaxWireGeom, &parallaxWireFrag };
+      parallaxWireMaterial = std::make_unique<ShaderProgram>(progs);
+
+      progs = { &parallaxWireVert, &parallaxWireGeom, &texturedParallaxWireFrag };
+      texturedParallaxWireMaterial = std::make_unique<ShaderProgram>(progs);
     }
   }
 
-  for (int threadgroupSizeEnum = 0; threadgroupSizeEnum < (int)ThreadgroupSize::Max; threadgroupSizeEnum++)
-  for (int normalMode = 0; normalMode < (int)NormalMode::Max; normalMode++)
-  for (int clipMode = 0; clipMode < (int)ClippingMode::Max; clipMode++)
-  {
-    std::filesystem::path csPath = std::filesystem::path(SHADERS_DIR) / "tilegen.glsl";
+  // Permutations compile on first use, start the ones the default settings draw with.
+  s_subdivShaders = std::make_unique<ShaderPermutations>(std::initializer_list<int>{ 2, (int)SubdivLevel::Count, 2 },
+    [](std::span<const int> coords) {
+      std::filesystem::path subdivVertPath = std::filesystem::path(SHADERS_DIR) / "subdiv.vs";
+      std::filesystem::path tcsPath = std::filesystem::path(SHADERS_DIR) / "subdiv.tcs";
+      std::filesystem::path tevPath = std::filesystem::path(SHADERS_DIR) / "subdiv.tev";
+      std::filesystem::path gsPath = std::filesystem::path(SHADERS_DIR) / "wireframe.gs";
+      std::filesystem::path fragPath = std::filesystem::path(SHADERS_DIR) / (coords[0] ? "textured.fs" : "simple.fs");
 
-    Shader::DefinesList defines;
+      Shader::DefinesList meshDefines;
+      addVertexFormatDefines(meshDefines);
 
-    defines.push_back({ "TILE_THREADGROUPS_X", std::to_string(getThreadgroupSize((ThreadgroupSize)threadgroupSizeEnum))});
-    defines.push_back({ "ENABLE_CLIPPING", clipMode == 1 ? "1" : "0" });
-    defines.push_back({ "SMOOTH_NORMALS", normalMode == 1 ? "1" : "0" });
+      Shader::DefinesList defines;
+      defines.push_back({ "TESS_LEVEL", std::to_string(getSubdivLevel((SubdivLevel)coords[1])) });
 
-    // these are destructed when the function exits.
-    Shader computeProg(GL_COMPUTE_SHADER, csPath.string(), defines);
+      // The wireframe variant gets its barycentrics from a geometry shader.
+      bool bWireframeGeometry = coords[2] != 0;
+      Shader::DefinesList tevDefines = { { "WIREFRAME_GEOMETRY", bWireframeGeometry ? "1" : "0" } };
+      Shader::DefinesList fragDefines;
+      addBarycentricDefines(fragDefines, bWireframeGeometry ? Barycentrics::Interpolated : s_barycentricExtension);
 
-    std::vector<Shader*> progs = { &computeProg };
-    getTilegenShader((ClippingMode)clipMode, (NormalMode)normalMode, (ThreadgroupSize)threadgroupSizeEnum) = std::make_unique<ShaderProgram>(progs);
-  }
+      // these are destructed when the function exits.
+      Shader subdivVert(GL_VERTEX_SHADER, subdivVertPath.string(), meshDefines);
+      Shader tcs(GL_TESS_CONTROL_SHADER, tcsPath.string(), defines);
+      Shader tev(GL_TESS_EVALUATION_SHADER, tevPath.string(), tevDefines);
+      Shader geom(GL_GEOMETRY_SHADER, gsPath.string());
+      Shader frag(GL_FRAGMENT_SHADER, fragPath.string(), fragDefines);
+
+      std::vector<Shader*> progs = { &subdivVert, &tcs, &tev, &frag };
+      if (bWireframeGeometry)
+        progs.push_back(&geom);
+      return std::make_unique<ShaderProgram>(progs, true);
+    });
+  s_subdivShaders->request({ 0, s_subdivLevel, 0 });
+  s_subdivShaders->request({ 1, s_subdivLevel, 0 });
+
+  s_tilegenShaders = std::make_unique<ShaderPermutations>(std::initializer_list<int>{ (int)ClippingMode::Max, (int)NormalMode::Max, (int)ThreadgroupSize::Max },
+    [](std::span<const int> coords) {
+      std::filesystem::path csPath = std::filesystem::path(SHADERS_DIR) / "tilegen.glsl";
+
+      Shader::DefinesList defines;
+
+      defines.push_back({ "TILE_THREADGROUPS_X", std::to_string(getThreadgroupSize((ThreadgroupSize)coords[2]))});
+      defines.push_back({ "ENABLE_CLIPPING", coords[0] == 1 ? "1" : "0" });
+      defines.push_back({ "SMOOTH_NORMALS", coords[1] == 1 ? "1" : "0" });
+      addVertexFormatDefines(defines);
+
+      // these are destructed when the function exits.
+      Shader computeProg(GL_COMPUTE_SHADER, csPath.string(), defines);
 
+      std::vector<Shader*> progs = { &computeProg };
+      return std::make_unique<ShaderProgram>(progs, true);
+    });
+  s_tilegenShaders->request({ (int)(s_bEnableClipping ? ClippingMode::On : ClippingMode::Off)
+    , (int)(s_bSmoothNormals ? NormalMode::Smooth : NormalMode::Flat)
+    , (int)s_threadgroupSize });
 }
 
 static void drawUI(GLFWwindow* window, double dt)
@@ -763,6 +1078,55 @@ static void drawUI(GLFWwindow* window, double dt)
   snprintf(fpsStr, sizeof(fpsStr), "%d triangles", s_nTrianglesOnScreen);
   ImGui::Text(fpsStr);
 
+  snprintf(fpsStr, sizeof(fpsStr), "%zu passes culled, %zu barriers", s_frameGraph->numCulled(), s_frameGraph->numBarriers());
+  ImGui::Text(fpsStr);
+
+#ifdef GL_STATS
+  if (ImGui::TreeNode("GL calls"))
+  {
+    // One row per counter, the frame total followed by each executed pass.
+    const std::vector<FrameGraph::PassResult>& passes = s_frameGraph->getResults();
+    if (ImGui::BeginTable("##glstats", 2 + (int)passes.size(), ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollX))
+    {
+      ImGui::TableSetupColumn("");
+      ImGui::TableSetupColumn("Frame");
+      for (const FrameGraph::PassResult& pass : passes)
+        ImGui::TableSetupColumn(pass.name.c_str());
+      ImGui::TableHeadersRow();
+
+      for (size_t i = 0; i < (size_t)GLStats::Counter::Max; i++)
+      {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Text("%s", GLStats::getName((GLStats::Counter)i));
+        ImGui::TableNextColumn();
+        ImGui::Text("%u", GLStats::frame()[i]);
+        for (const FrameGraph::PassResult& pass : passes)
+        {
+          ImGui::TableNextColumn();
+          ImGui::Text("%u", pass.counters[i]);
+        }
+      }
+      ImGui::EndTable();
+    }
+    ImGui::TreePop();
+  }
+#endif // GL_STATS
+
+  TextureManager& textures = TextureManager::global();
+  snprintf(fpsStr, sizeof(fpsStr), "%zu textures, %.1f MB (%zu hits, %zu misses)", textures.numTextures(),
+    textures.residentBytes() / (1024.0 * 1024.0), textures.numHits(), textures.numMisses());
+  ImGui::Text(fpsStr);
+
+  snprintf(fpsStr, sizeof(fpsStr), "%zu of %zu shader variants compiled (%zu requested)", s_tilegenShaders->numReady() + s_subdivShaders->numReady(),
+    s_tilegenShaders->numVariants() + s_subdivShaders->numVariants(), s_tilegenShaders->numRequested() + s_subdivShaders->numRequested());
+  ImGui::Text(fpsStr);
+
+  TextureStreamer& streamer = TextureStreamer::global();
+  int uploadBudgetKB = (int)(streamer.getUploadBudget() / 1024);
+  if (ImGui::SliderInt("Texture upload KB/frame", &uploadBudgetKB, 256, 64 * 1024))
+    streamer.setUploadBudget((size_t)uploadBudgetKB * 1024);
+
   ImGui::Combo("Target Mesh", &s_curMeshTarget, s_meshTargetNames, IM_ARRAYSIZE(s_meshTargetNames));
   ImGui::Combo("Tilemesh", &s_curTilemesh, s_tileMeshNames, IM_ARRAYSIZE(s_tileMeshNames));
 
@@ -773,6 +1137,9 @@ static void drawUI(GLFWwindow* window, double dt)
   ImGui::Checkbox("Draw Tessellated Mesh", &s_bDrawTessellatedMesh);
   ImGui::Combo("Tessellation Level", &s_subdivLevel, s_subdivLevelNames, IM_ARRAYSIZE(s_subdivLevelNames));
 
+  ImGui::Checkbox("Draw Parallax Mesh", &s_bDrawParallaxMesh);
+  ImGui::SliderInt("Parallax Steps", &s_parallaxSteps, 4, 128);
+
   ImGui::Checkbox("Draw Normal Vectors", &s_bDrawNormalVectors);
 
   if (ImGui::Button("Generate Tilemesh"))
@@ -0,0 +1,133 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+MappedFile::MappedFile()
+  : m_data(nullptr)
+  , m_size(0)
+#ifdef _WIN32
+  , m_file(nullptr)
+  , m_mapping(nullptr)
+#else
+  , m_fd(-1)
+#endif // _WIN32
+{
+}
+
+MappedFile::MappedFile(const std::string& path)
+  : MappedFile()
+{
+  open(path);
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path)
+{
+  close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!data)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  m_file = file;
+  m_mapping = mapping;
+  m_data = data;
+  m_size = (size_t)size.QuadPart;
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (m_data)
+    UnmapViewOfFile(m_data);
+  if (m_mapping)
+    CloseHandle((HANDLE)m_mapping);
+  if (m_file)
+    CloseHandle((HANDLE)m_file);
+
+  m_data = nullptr;
+  m_size = 0;
+  m_file = nullptr;
+  m_mapping = nullptr;
+}
+
+#else // !_WIN32
+
+bool MappedFile::open(const std::string& path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  m_fd = fd;
+  m_data = data;
+  m_size = (size_t)st.st_size;
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (m_data)
+    munmap(const_cast<void*>(m_data), m_size);
+  if (m_fd >= 0)
+    ::close(m_fd);
+
+  m_data = nullptr;
+  m_size = 0;
+  m_fd = -1;
+}
+
+#endif // _WIN32
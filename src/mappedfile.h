@@ -0,0 +1,37 @@
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+protected:
+  const void* m_data;
+  size_t m_size;
+
+#ifdef _WIN32
+  void* m_file;
+  void* m_mapping;
+#else
+  int m_fd;
+#endif // _WIN32
+
+public:
+  MappedFile();
+  MappedFile(const std::string& path);
+  ~MappedFile();
+
+  // delete copy constructor
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool open(const std::string& path);
+  void close();
+
+  inline bool isOpen() const { return m_data != nullptr; }
+  inline const void* data() const { return m_data; }
+  inline size_t size() const { return m_size; }
+};
+
+#endif // _MAPPEDFILE_H
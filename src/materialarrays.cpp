@@ -0,0 +1,139 @@
+#include "materialarrays.h"
+#include <iostream>
+#include <unordered_map>
+#include <algorithm>
+
+MaterialArrays::~MaterialArrays()
+{
+  release();
+}
+
+void MaterialArrays::release()
+{
+  if (!m_arrays.empty())
+  {
+    glDeleteTextures((GLsizei)m_arrays.size(), m_arrays.data());
+    m_arrays.clear();
+  }
+
+  if (m_materialBuffer)
+  {
+    glDeleteBuffers(1, &m_materialBuffer);
+    m_materialBuffer = 0;
+  }
+}
+
+MaterialArrays::Status MaterialArrays::build(std::span<const std::shared_ptr<Texture>> textures)
+{
+  for (const std::shared_ptr<Texture>& texture : textures)
+  {
+    if (texture && !texture->isComplete() && !texture->isFailed())
+      return Status::Pending;
+  }
+
+  release();
+
+  struct Format
+  {
+    GLint internalFormat;
+    GLint width;
+    GLint height;
+    GLint numLevels;
+
+    inline bool operator==(const Format& rhs) const
+    {
+      return internalFormat == rhs.internalFormat && width == rhs.width && height == rhs.height && numLevels == rhs.numLevels;
+    }
+  };
+
+  // Group textures by format, materials sharing a texture share its layer.
+  std::vector<Format> formats;
+  std::vector<std::vector<GLuint>> layers;
+  std::unordered_map<GLuint, Material> placed;
+  std::vector<Material> materials(textures.size(), { -1, 0, 0, 0 });
+  for (size_t i = 0; i < textures.size(); i++)
+  {
+    const std::shared_ptr<Texture>& texture = textures[i];
+    if (!texture || texture->isFailed())
+      continue;
+
+    GLuint id = texture->getId();
+    auto it = placed.find(id);
+    if (it != placed.end())
+    {
+      materials[i] = it->second;
+      continue;
+    }
+
+    Format format;
+    glGetTextureLevelParameteriv(id, 0, GL_TEXTURE_INTERNAL_FORMAT, &format.internalFormat);
+    glGetTextureLevelParameteriv(id, 0, GL_TEXTURE_WIDTH, &format.width);
+    glGetTextureLevelParameteriv(id, 0, GL_TEXTURE_HEIGHT, &format.height);
+    glGetTextureParameteriv(id, GL_TEXTURE_IMMUTABLE_LEVELS, &format.numLevels);
+
+    size_t array = std::find(formats.begin(), formats.end(), format) - formats.begin();
+    if (array == formats.size())
+    {
+      if (formats.size() == MAX_ARRAYS)
+      {
+        std::cerr << "MaterialArrays::build> Materials need more than " << MAX_ARRAYS << " texture arrays.\n";
+        return Status::Unsupported;
+      }
+
+      formats.push_back(format);
+      layers.emplace_back();
+    }
+
+    Material material = { (int)array, (int)layers[array].size(), 0, 0 };
+    layers[array].push_back(id);
+    placed[id] = material;
+    materials[i] = material;
+  }
+
+  m_arrays.resize(formats.size());
+  if (!m_arrays.empty())
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, (GLsizei)m_arrays.size(), m_arrays.data());
+
+  for (size_t iArray = 0; iArray < formats.size(); iArray++)
+  {
+    const Format& format = formats[iArray];
+    GLuint array = m_arrays[iArray];
+
+    glTextureParameteri(array, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(array, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTextureParameteri(array, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(array, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // The swizzle follows from the internal format, so every layer shares it.
+    GLint swizzle[4];
+    glGetTextureParameteriv(layers[iArray][0], GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    glTextureParameteriv(array, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+    glTextureStorage3D(array, format.numLevels, format.internalFormat, format.width, format.height, (GLsizei)layers[iArray].size());
+
+    for (size_t layer = 0; layer < layers[iArray].size(); layer++)
+    {
+      for (GLint level = 0; level < format.numLevels; level++)
+      {
+        GLint width = std::max(format.width >> level, 1);
+        GLint height = std::max(format.height >> level, 1);
+        glCopyImageSubData(layers[iArray][layer], GL_TEXTURE_2D, level, 0, 0, 0,
+          array, GL_TEXTURE_2D_ARRAY, level, 0, 0, (GLint)layer, width, height, 1);
+      }
+    }
+  }
+
+  glCreateBuffers(1, &m_materialBuffer);
+  glNamedBufferStorage(m_materialBuffer, std::max<size_t>(materials.size(), 1) * sizeof(Material), materials.data(), 0);
+
+  std::cout << "MaterialArrays::build> " << placed.size() << " textures in " << m_arrays.size() << " arrays.\n";
+  return Status::Ready;
+}
+
+void MaterialArrays::bind(GLuint firstUnit) const
+{
+  for (size_t i = 0; i < m_arrays.size(); i++)
+    glBindTextureUnit(firstUnit + (GLuint)i, m_arrays[i]);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, m_materialBuffer);
+}
@@ -0,0 +1,60 @@
+#ifndef _MATERIALARRAYS_H
+#define _MATERIALARRAYS_H
+#include <glad/glad.h>
+#include <vector>
+#include <memory>
+#include <span>
+#include "texture.h"
+
+// Material textures packed into GL_TEXTURE_2D_ARRAY layers, one array per internal format
+// and size, so a shader picks each draw's texture by index instead of by binding.
+//
+// The per-draw table lives in an SSBO at MATERIAL_BINDING and is indexed with gl_DrawID;
+// the arrays bind to consecutive texture units. Layers are copied from the streamed
+// textures once all of them are complete.
+class MaterialArrays
+{
+public:
+  static const int MAX_ARRAYS = 8;
+  static const GLuint MATERIAL_BINDING = 5;
+
+  // std430 layout, array is -1 for draws without a texture.
+  struct Material
+  {
+    int array;
+    int layer;
+    int padding0;
+    int padding1;
+  };
+
+  enum class Status
+  {
+    Pending,
+    Ready,
+    Unsupported,
+  };
+
+protected:
+  std::vector<GLuint> m_arrays;
+  GLuint m_materialBuffer;
+
+public:
+  MaterialArrays() : m_materialBuffer(0) { }
+  ~MaterialArrays();
+
+  // delete copy constructor
+  MaterialArrays(const MaterialArrays&) = delete;
+  MaterialArrays& operator=(const MaterialArrays&) = delete;
+
+  // One material per entry of `textures`, which may be null. Pending while any texture is
+  // still streaming; Unsupported if they need more than MAX_ARRAYS arrays.
+  Status build(std::span<const std::shared_ptr<Texture>> textures);
+  void release();
+
+  inline bool isBuilt() const { return m_materialBuffer != 0; }
+  inline size_t numArrays() const { return m_arrays.size(); }
+
+  void bind(GLuint firstUnit) const;
+};
+
+#endif // _MATERIALARRAYS_H
@@ -1,120 +1,100 @@
 #include "mesh.h"
+#include "meshcache.h"
+#include "objreader.h"
+#include "meshoptimizer.h"
+#include "meshtangents.h"
+#include "loadarena.h"
+#include "texturemanager.h"
 #include <glad/glad.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-
 #include <iostream>
 #include <filesystem>
+#include <mutex>
+#include <future>
+#include <format>
 
-// https://github.com/assimp/assimp/blob/master/code/PostProcessing/CalcTangentsProcess.cpp
-static void ComputeBasis(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec2& u0, const glm::vec2& u1, const glm::vec2& u2, glm::vec3& tangent, glm::vec3& bitangent)
+#ifdef COMPACT_VERTEX_FORMAT
+static inline int16_t packSnorm16(float v)
 {
-  glm::vec3 v = (p1 - p0);
-  glm::vec3 w = (p2 - p0);
-  glm::vec2 s = u1 - u0;
-  glm::vec2 t = u2 - u0;
+  return (int16_t)std::round(std::clamp(v, -1.f, 1.f) * 32767.f);
+}
 
-  float dirCorrect = (t.x * s.y - t.y * s.x) < 0 ? -1 : 1;
-  if (s.x * t.y == s.y * t.x)
+// Octahedral encoding of a unit vector into [-1, 1]^2.
+static glm::vec2 octEncode(const glm::vec3& n)
+{
+  float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if (l1 == 0.f)
+    return glm::vec2(0.f);
+
+  glm::vec2 p = glm::vec2(n.x, n.y) / l1;
+  if (n.z < 0.f)
   {
-    s = glm::vec2(0, 1);
-    t = glm::vec2(1, 0);
+    glm::vec2 signs(p.x >= 0.f ? 1.f : -1.f, p.y >= 0.f ? 1.f : -1.f);
+    p = (1.f - glm::abs(glm::vec2(p.y, p.x))) * signs;
   }
-
-  tangent = (w * s.y - v * t.y) * dirCorrect;
-  bitangent = (w * s.x - v * t.x) * dirCorrect;
+  return p;
 }
 
-static void CalcTangents(MeshPartData& part)
+static CompactMeshVertex packMeshVertex(const MeshVertex& vtx, const glm::vec3& positionScale, const glm::vec3& positionOffset)
 {
-  int nTriangles = part.idx.size() / 3;
-  for (int iTri = 0; iTri < nTriangles; ++iTri)
-  {
-    MeshVertex& v0 = part.vtx[part.idx[iTri * 3 + 0]];
-    MeshVertex& v1 = part.vtx[part.idx[iTri * 3 + 1]];
-    MeshVertex& v2 = part.vtx[part.idx[iTri * 3 + 2]];
-
-    glm::vec3 tangent;
-    glm::vec3 bitangent;
-    ComputeBasis(v0.position, v1.position, v2.position, v0.uv, v1.uv, v2.uv, tangent, bitangent);
-
-    glm::vec3 faceNormal = glm::normalize(glm::cross(v1.position - v0.position, v2.position - v0.position));
-    glm::vec3 estimatedBitangent = glm::normalize(glm::cross(faceNormal, tangent));
+  CompactMeshVertex packed;
+
+#ifdef QUANTIZED_POSITIONS
+  glm::vec3 q = (vtx.position - positionOffset) / positionScale;
+  packed.position[0] = packSnorm16(q.x);
+  packed.position[1] = packSnorm16(q.y);
+  packed.position[2] = packSnorm16(q.z);
+  packed.position[3] = 0;
+#else
+  packed.position = vtx.position;
+#endif // QUANTIZED_POSITIONS
+
+  glm::vec2 normal = octEncode(vtx.normal);
+  packed.frame[0] = packSnorm16(normal.x);
+  packed.frame[1] = packSnorm16(normal.y);
 
-    float bitangentSign = glm::sign(glm::dot(bitangent, estimatedBitangent)) * -1;
+#ifdef TANGENT_BASIS
+  glm::vec2 tangent = octEncode(glm::vec3(vtx.tangent));
+  packed.frame[2] = packSnorm16(tangent.x);
+  packed.frame[3] = (int16_t)((packSnorm16(tangent.y) & ~1) | (vtx.tangent.w < 0.f ? 1 : 0));
+#else
+  packed.frame[2] = 0;
+  packed.frame[3] = 0;
+#endif // TANGENT_BASIS
 
-    v0.tangent = glm::vec4(tangent, bitangentSign);
-    v1.tangent = glm::vec4(tangent, bitangentSign);
-    v2.tangent = glm::vec4(tangent, bitangentSign);
-  }
+  packed.uv = glm::packHalf2x16(vtx.uv);
+  return packed;
 }
-
-MeshPart::MeshPart(const MeshPartData& data)
+#endif // COMPACT_VERTEX_FORMAT
+
+MeshPart::MeshPart(const MeshPartView& data, GLuint VAO, GLuint firstIndex, GLint baseVertex, GLenum indexType, std::pmr::memory_resource* scratch)
+  : VAO(VAO)
+  , firstIndex(firstIndex)
+  , baseVertex(baseVertex)
+  , numElements(0)
+  , indexType(indexType)
+  , debugLine_VAO(0)
+  , debugLine_VBO(0)
+  , numDebugLineVerts(0)
 {
   if (!data.diffuseTex.empty())
-  {
-    std::cout << "Loading texture '" << data.diffuseTex << "'\n";
-    diffuseTex = std::make_unique<Texture>(data.diffuseTex);
-  }
+    diffuseTex = TextureManager::global().acquire(data.diffuseTex, TextureUsage::Color, TextureCompression::Block);
 
   if (data.vtx.empty() || data.idx.empty())
-  {
-    VAO = VBO = EBO = numElements = 0;
     return;
-  }
-
-  glGenVertexArrays(1, &VAO);
-  glBindVertexArray(VAO);
-
-  // init VBO
-  glGenBuffers(1, &VBO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, data.vtx.size() * sizeof(MeshVertex), (void*)data.vtx.data(), GL_STATIC_DRAW);
 
-  // init EBO
-  glGenBuffers(1, &EBO);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.idx.size() * sizeof(unsigned int), (void*)data.idx.data(), GL_STATIC_DRAW);
   numElements = data.idx.size();
 
   size_t size;
   size_t offset = 0;
 
-  // Setup VAO:
-  // position
-  size = 3 * sizeof(float);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offset);
-  offset += size;
-
-  // normal
-  size = 3 * sizeof(float);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offset);
-  offset += size;
-
-#ifdef TANGENT_BASIS
-  size = 4 * sizeof(float);
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offset);
-  offset += size;
-#endif // TANGENT_BASIS
-
-  // uv
-  size = 2 * sizeof(float);
-  glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offset);
-  offset += size;
-
-  glBindVertexArray(0);
-
   struct DebugVertex
   {
     glm::vec3 pos;
   };
 
-  std::vector<DebugVertex> debugVertices;
+  std::pmr::vector<DebugVertex> debugVertices(scratch);
+  debugVertices.reserve(2 * data.vtx.size());
   for (const auto& vtx : data.vtx)
   {
     DebugVertex v;
@@ -146,24 +126,6 @@ MeshPart::MeshPart(const MeshPartData& data)
 
 MeshPart::~MeshPart()
 {
-  if (VAO)
-  {
-    glDeleteVertexArrays(1, &VAO);
-    VAO = 0;
-  }
-
-  if (VBO)
-  {
-    glDeleteBuffers(1, &VBO);
-    VBO = 0;
-  }
-
-  if (EBO)
-  {
-    glDeleteBuffers(1, &EBO);
-    EBO = 0;
-  }
-
   if (debugLine_VAO)
   {
     glDeleteVertexArrays(1, &debugLine_VAO);
@@ -186,14 +148,20 @@ void MeshPart::draw() const
   }
 
   glBindVertexArray(VAO);
-  glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, 0);
+  glDrawElementsBaseVertex(GL_TRIANGLES, numElements, indexType, indexOffset(), baseVertex);
+}
+
+void MeshPart::drawGeometry() const
+{
+  glBindVertexArray(VAO);
+  glDrawElementsBaseVertex(GL_TRIANGLES, numElements, indexType, indexOffset(), baseVertex);
 }
 
 void MeshPart::drawPatches() const
 {
   glPatchParameteri(GL_PATCH_VERTICES, 3);
   glBindVertexArray(VAO);
-  glDrawElements(GL_PATCHES, numElements, GL_UNSIGNED_INT, 0);
+  glDrawElementsBaseVertex(GL_PATCHES, numElements, indexType, indexOffset(), baseVertex);
 }
 
 void MeshPart::drawNormalVectors() const
@@ -202,190 +170,221 @@ void MeshPart::drawNormalVectors() const
   glDrawArrays(GL_LINES, 0, numDebugLineVerts);
 }
 
-static void loadParts(tinyobj::ObjReader& reader, std::vector<MeshPartData>& partData, const std::string& materialsPath, bool ignoreMaterials = false)
+TargetGeometryStream::TargetGeometryStream(std::span<const Triangle> triangles)
 {
-  auto& attrib = reader.GetAttrib();
-  auto& shapes = reader.GetShapes();
-  auto& materials = reader.GetMaterials();
+  glCreateBuffers(1, &TriangleStream);
 
-  // Add an extra default material.
-  if (!ignoreMaterials)
-  {
-    partData.resize(1 + materials.size(), MeshPartData());
+  numElements = triangles.size();
+  glNamedBufferStorage(TriangleStream, triangles.size_bytes(), triangles.data(), 0);
+}
 
-    // Load materials.
-    for (int i = 0; i < materials.size(); i++)
-    {
-      //std::cout << materialsPath << "\n";
-      const std::string& texname = materials[i].diffuse_texname;
-      if (!texname.empty())
-      {
-        partData[i + 1].diffuseTex = std::format("{}/{}", materialsPath, materials[i].diffuse_texname);
-      }
-    }
-  }
-  else
-  {
-    partData.resize(1, MeshPartData());
-  }
+// Uvs are stored with six decimals, corners that should match can be off by one ulp of that.
+static const float QUAD_UV_EPSILON = 1e-5f;
+
+static inline bool uvEqual(float a, float b)
+{
+  return std::abs(a - b) <= QUAD_UV_EPSILON;
+}
 
-  // Loop over shapes
-  for (size_t iShape = 0; iShape < shapes.size(); iShape++)
+// The corner loop q forms a quad whose uvs span an axis-aligned rectangle. On success the
+// corners are reordered by uv: min/min, max/min, max/max, min/max.
+static bool matchUVQuad(const MeshVertex* q[4])
+{
+  // Edges alternate between constant v and constant u, starting with either.
+  bool bAlignedU = uvEqual(q[0]->uv.y, q[1]->uv.y) && uvEqual(q[1]->uv.x, q[2]->uv.x)
+    && uvEqual(q[2]->uv.y, q[3]->uv.y) && uvEqual(q[3]->uv.x, q[0]->uv.x);
+  bool bAlignedV = uvEqual(q[0]->uv.x, q[1]->uv.x) && uvEqual(q[1]->uv.y, q[2]->uv.y)
+    && uvEqual(q[2]->uv.x, q[3]->uv.x) && uvEqual(q[3]->uv.y, q[0]->uv.y);
+  if (!bAlignedU && !bAlignedV)
+    return false;
+
+  glm::vec2 uvMin = glm::min(glm::min(q[0]->uv, q[1]->uv), glm::min(q[2]->uv, q[3]->uv));
+  glm::vec2 uvMax = glm::max(glm::max(q[0]->uv, q[1]->uv), glm::max(q[2]->uv, q[3]->uv));
+  if (uvMax.x - uvMin.x <= QUAD_UV_EPSILON || uvMax.y - uvMin.y <= QUAD_UV_EPSILON)
+    return false;
+
+  glm::vec2 center = (uvMin + uvMax) * 0.5f;
+  const MeshVertex* sorted[4] = {};
+  for (int i = 0; i < 4; i++)
   {
-    const tinyobj::shape_t& shape = shapes[iShape];
-    const tinyobj::mesh_t& mesh = shape.mesh;
+    bool bRight = q[i]->uv.x > center.x;
+    bool bTop = q[i]->uv.y > center.y;
+    int slot = bTop ? (bRight ? 2 : 3) : (bRight ? 1 : 0);
+    if (sorted[slot])
+      return false;
+    sorted[slot] = q[i];
+  }
 
-    // Loop over faces(polygon)
-    size_t index_offset = 0;
-    for (size_t iFace = 0; iFace < mesh.num_face_vertices.size(); ++iFace)
-    {
-      int materialId = mesh.material_ids[iFace];
-      if (ignoreMaterials)
-        materialId = -1;
-      
-      MeshPartData& part = partData[materialId + 1];
-
-      size_t fv = size_t(mesh.num_face_vertices[iFace]);
-      if (fv != 3)
-      {
-        std::cerr << "Non-triangle meshes not supported!\n";
-        index_offset += fv;
-        continue;
-      }
+  for (int i = 0; i < 4; i++)
+    q[i] = sorted[i];
+  return true;
+}
 
+static void setTileRange(TargetGeometryStream::Triangle& tri, glm::vec2 uvMin, glm::vec2 uvMax, int& tileBase)
+{
+  // TODO: factor in area in compute shader.
+  const float tileWidth = 1.0f;
+  const float tileHeight = 1.0f;
+
+  int startX = (int)(uvMin.x / tileWidth);
+  int endX = (int)(uvMax.x / tileWidth + 0.99f);
+  int startY = (int)(uvMin.y / tileWidth);
+  int endY = (int)(uvMax.y / tileWidth + 0.99f);
+
+  int numTilesX = endX - startX;
+  int numTilesY = endY - startY;
+  //numTilesX = 1;
+  //numTilesY = 1;
+
+  int numTiles = numTilesX * numTilesY;
+
+  tri.tileBase = tileBase;
+  tri.tilesX = numTilesX;
+  tri.tilesY = numTilesY;
+  tri.tileStartX = startX;
+  tri.tileStartY = startY;
+  tileBase += numTiles;
+}
 
-      for (size_t v = 0; v < fv; v++) {
-        // access to vertex
-        tinyobj::index_t idx = mesh.indices[index_offset + v];
-        MeshIndexKey triple{ idx.vertex_index, idx.normal_index, idx.texcoord_index };
-        auto found = part.idxToVtxCache.find(triple);
-        unsigned int iVertex;
-
-        if (found != part.idxToVtxCache.end())
-        {
-          iVertex = found->second;
-        }
-        else
-        {
-          // Cache this vertex.
-          MeshVertex vertex;
-
-          tinyobj::real_t vx = attrib.vertices[3 * size_t(idx.vertex_index) + 0];
-          tinyobj::real_t vy = attrib.vertices[3 * size_t(idx.vertex_index) + 1];
-          tinyobj::real_t vz = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
-          vertex.position = glm::vec3(vx, vy, vz);
-
-          // Check if `normal_index` is zero or positive. negative = no normal data
-          if (idx.normal_index >= 0) {
-            tinyobj::real_t nx = attrib.normals[3 * size_t(idx.normal_index) + 0];
-            tinyobj::real_t ny = attrib.normals[3 * size_t(idx.normal_index) + 1];
-            tinyobj::real_t nz = attrib.normals[3 * size_t(idx.normal_index) + 2];
-            vertex.normal = glm::vec3(nx, ny, nz);
-          }
-
-          // Check if `texcoord_index` is zero or positive. negative = no texcoord data
-          if (idx.texcoord_index >= 0) {
-            tinyobj::real_t tx = attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
-            tinyobj::real_t ty = attrib.texcoords[2 * size_t(idx.texcoord_index) + 1];
-
-            //vertex.uv = glm::vec2(tx, ty);
-
-            // flip uv
-            vertex.uv = glm::vec2(tx, 1.0f - ty);
-          }
-
-          // Optional: vertex colors
-          // tinyobj::real_t red   = attrib.colors[3*size_t(idx.vertex_index)+0];
-          // tinyobj::real_t green = attrib.colors[3*size_t(idx.vertex_index)+1];
-          // tinyobj::real_t blue  = attrib.colors[3*size_t(idx.vertex_index)+2];
-
-          // Only support uint indices.
-          if (part.vtx.size() >= std::numeric_limits<unsigned int>::max())
-            std::cerr << "Index out of bounds!\n";
-
-          iVertex = part.vtx.size();
-          part.vtx.push_back(vertex);
-          part.idxToVtxCache[triple] = iVertex;
-        }
-
-        // Add vertex to index list.
-        part.idx.push_back(iVertex);
-      }
-      index_offset += fv;
-    }
-  }
+static void buildTargetTriangle(TargetGeometryStream::Triangle& tri, const MeshVertex& v0, const MeshVertex& v1, const MeshVertex& v2, int& tileBase)
+{
+  tri.p0 = v0.position;
+  tri.p1 = v1.position;
+  tri.p2 = v2.position;
+
+  // barycentric triangle coord to 2D uv point.
+  glm::mat3 baryToUV(
+    glm::vec3(v0.uv, 1.f),
+    glm::vec3(v1.uv, 1.f),
+    glm::vec3(v2.uv, 1.f)
+  );
+
+  glm::mat3 uvToBary = glm::inverse(baryToUV);
+
+  glm::vec3 normal = glm::normalize(glm::cross(glm::normalize(v1.position - v0.position), glm::normalize(v2.position - v0.position)));
+  tri.normal = normal;
+
+  // TODO: This is wrong.
+  //tri.tangent = glm::normalize(v1.position - v0.position);
+
+  tri.uvToBary0 = uvToBary[0];
+  tri.uvToBary1 = uvToBary[1];
+  tri.uvToBary2 = uvToBary[2];
+  // tri.uvToBary = uvToBary;
+
+  tri.n0 = glm::normalize(v0.normal);
+  tri.n1 = glm::normalize(v1.normal);
+  tri.n2 = glm::normalize(v2.normal);
+  tri.p3 = glm::vec3(0.f);
+  tri.n3 = glm::vec3(0.f);
+  tri.primitiveType = (int)TargetGeometryStream::PrimitiveType::Triangle;
+
+  glm::vec2 uvMin = glm::min(glm::min(v0.uv, v1.uv), v2.uv);
+  glm::vec2 uvMax = glm::max(glm::max(v0.uv, v1.uv), v2.uv);
+  setTileRange(tri, uvMin, uvMax, tileBase);
 }
 
-TargetGeometryStream::TargetGeometryStream(const MeshPartData& data)
+static void buildTargetQuad(TargetGeometryStream::Triangle& quad, const MeshVertex* q[4], const glm::vec3& normal, int& tileBase)
 {
-  glCreateBuffers(1, &TriangleStream);
+  quad.p0 = q[0]->position;
+  quad.p1 = q[1]->position;
+  quad.p2 = q[2]->position;
+  quad.p3 = q[3]->position;
+
+  quad.normal = normal;
+
+  glm::vec2 uvMin = q[0]->uv;
+  glm::vec2 uvMax = q[2]->uv;
+  quad.uvToBary0 = glm::vec3(uvMin, 0.f);
+  quad.uvToBary1 = glm::vec3(1.f / (uvMax.x - uvMin.x), 1.f / (uvMax.y - uvMin.y), 0.f);
+  quad.uvToBary2 = glm::vec3(uvMax, 0.f);
+
+  quad.n0 = glm::normalize(q[0]->normal);
+  quad.n1 = glm::normalize(q[1]->normal);
+  quad.n2 = glm::normalize(q[2]->normal);
+  quad.n3 = glm::normalize(q[3]->normal);
+  quad.primitiveType = (int)TargetGeometryStream::PrimitiveType::Quad;
+
+  setTileRange(quad, uvMin, uvMax, tileBase);
+}
 
-  size_t numTriangles = data.idx.size() / 3;
-  numElements = numTriangles;
+void TargetGeometryStream::buildTriangles(std::span<const MeshPartData> parts, std::pmr::vector<Triangle>& stream)
+{
+  size_t numTriangles = 0;
+  for (const MeshPartData& data : parts)
+    numTriangles += data.idx.size() / 3;
 
   int tileBase = 0;
-  std::vector<Triangle> stream;
-  stream.resize(numTriangles);
-  for (size_t i = 0; i < numTriangles; i++)
-  {
-    const MeshVertex& v0 = data.vtx[data.idx[i * 3 + 0]];
-    const MeshVertex& v1 = data.vtx[data.idx[i * 3 + 1]];
-    const MeshVertex& v2 = data.vtx[data.idx[i * 3 + 2]];
-    stream[i].p0 = v0.position;
-    stream[i].p1 = v1.position;
-    stream[i].p2 = v2.position;
-
-    // barycentric triangle coord to 2D uv point.
-    glm::mat3 baryToUV(
-      glm::vec3(v0.uv, 1.f),
-      glm::vec3(v1.uv, 1.f),
-      glm::vec3(v2.uv, 1.f)
-    );
-
-    glm::mat3 uvToBary = glm::inverse(baryToUV);
-
-    glm::vec3 normal = glm::normalize(glm::cross(glm::normalize(v1.position - v0.position), glm::normalize(v2.position - v0.position)));
-    stream[i].normal = normal;
-
-    // TODO: This is wrong.
-    //stream[i].tangent = glm::normalize(v1.position - v0.position);
-
-    stream[i].uvToBary0 = uvToBary[0];
-    stream[i].uvToBary1 = uvToBary[1];
-    stream[i].uvToBary2 = uvToBary[2];
-    // stream[i].uvToBary = uvToBary;
-
-    stream[i].n0 = glm::normalize(v0.normal);
-    stream[i].n1 = glm::normalize(v1.normal);
-    stream[i].n2 = glm::normalize(v2.normal);
-
-    // TODO: factor in area in compute shader.
-    const float tileWidth = 1.0f;
-    const float tileHeight = 1.0f;
-    glm::vec2 uvMin = glm::min(glm::min(v0.uv, v1.uv), v2.uv);
-    glm::vec2 uvMax = glm::max(glm::max(v0.uv, v1.uv), v2.uv);
-
-    int startX = (int)(uvMin.x / tileWidth);
-    int endX = (int)(uvMax.x / tileWidth + 0.99f);
-    int startY = (int)(uvMin.y / tileWidth);
-    int endY = (int)(uvMax.y / tileWidth + 0.99f);
-
-    int numTilesX = endX - startX;
-    int numTilesY = endY - startY;
-    //numTilesX = 1;
-    //numTilesY = 1;
-
-    int numTiles = numTilesX * numTilesY;
-
-    stream[i].tileBase = tileBase;
-    stream[i].tilesX = numTilesX;
-    stream[i].tilesY = numTilesY;
-    stream[i].tileStartX = startX;
-    stream[i].tileStartY = startY;
-    tileBase += numTiles;
+  stream.clear();
+  stream.reserve(numTriangles);
+
+  std::pmr::memory_resource* scratch = stream.get_allocator().resource();
+  size_t numQuads = 0;
+
+  for (const MeshPartData& data : parts)
+  {
+    const size_t partTriangles = data.idx.size() / 3;
+
+    // Directed edge to the first triangle containing it.
+    std::pmr::unordered_map<uint64_t, unsigned int> edges(scratch);
+    edges.reserve(data.idx.size());
+    for (size_t i = 0; i < data.idx.size(); i++)
+    {
+      uint64_t a = data.idx[i];
+      uint64_t b = data.idx[i - i % 3 + (i + 1) % 3];
+      edges.emplace((a << 32) | b, (unsigned int)(i / 3));
+    }
+
+    // Greedily pair each triangle with the first unpaired neighbour it forms a uv rectangle with.
+    std::pmr::vector<uint8_t> consumed(partTriangles, 0, scratch);
+    for (size_t t = 0; t < partTriangles; t++)
+    {
+      if (consumed[t])
+        continue;
+
+      const unsigned int* tri = &data.idx[t * 3];
+      bool bQuad = false;
+      for (int k = 0; k < 3 && !bQuad; k++)
+      {
+        uint64_t i0 = tri[k];
+        uint64_t i1 = tri[(k + 1) % 3];
+        auto it = edges.find((i1 << 32) | i0);
+        if (it == edges.end() || it->second == t || consumed[it->second])
+          continue;
+
+        // The neighbour's corner opposite the shared edge.
+        const unsigned int* other = &data.idx[it->second * 3];
+        unsigned int opposite = other[0] + other[1] + other[2] - (unsigned int)(i0 + i1);
+
+        const MeshVertex* q[4] = {
+          &data.vtx[i0],
+          &data.vtx[opposite],
+          &data.vtx[i1],
+          &data.vtx[tri[(k + 2) % 3]] };
+
+        // Face normal from the winding, matchUVQuad reverses the corners of mirrored uvs.
+        glm::vec3 normal = glm::normalize(glm::cross(q[2]->position - q[0]->position, q[3]->position - q[1]->position));
+        if (!matchUVQuad(q))
+          continue;
+
+        stream.emplace_back();
+        buildTargetQuad(stream.back(), q, normal, tileBase);
+        consumed[t] = 1;
+        consumed[it->second] = 1;
+        bQuad = true;
+        numQuads++;
+      }
+
+      if (!bQuad)
+      {
+        stream.emplace_back();
+        buildTargetTriangle(stream.back(), data.vtx[tri[0]], data.vtx[tri[1]], data.vtx[tri[2]], tileBase);
+        consumed[t] = 1;
+      }
+    }
   }
 
-  glNamedBufferStorage(TriangleStream, sizeof(Triangle) * numTriangles, stream.data(), 0);
+  std::cout << std::format("TargetGeometryStream::buildTriangles> {} quads, {} triangles\n", numQuads, stream.size() - numQuads);
 }
 
 TargetGeometryStream::~TargetGeometryStream()
@@ -398,22 +397,29 @@ void TargetGeometryStream::bind(int target) const
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, target, TriangleStream);
 }
 
-TileGeometryStreams::TileGeometryStreams(const MeshPartData& data)
+TileGeometryStreams::TileGeometryStreams(const MeshPartView& data, std::pmr::memory_resource* scratch)
 {
   glCreateBuffers(1, &VertexStream);
   glCreateBuffers(1, &IndexStream);
 
-  std::vector<Vertex> vertices;
+  std::pmr::vector<Vertex> vertices(scratch);
 
   vertices.resize(data.vtx.size());
   Vertex v;
   for (size_t i = 0; i < data.vtx.size(); i++)
   {
     v.position = data.vtx[i].position;
+    #ifdef COMPACT_VERTEX_FORMAT
+    v.normal = glm::packSnorm2x16(octEncode(data.vtx[i].normal));
+    #ifdef TILEMESH_UVS
+    v.uv = glm::packHalf2x16(data.vtx[i].uv);
+    #endif // TILEMESH_UVS
+    #else // !COMPACT_VERTEX_FORMAT
     v.normal = data.vtx[i].normal;
     #ifdef TILEMESH_UVS
     v.uv = data.vtx[i].uv;
     #endif // TILEMESH_UVS
+    #endif // !COMPACT_VERTEX_FORMAT
 
     vertices[i] = v;
   }
@@ -443,6 +449,12 @@ GPUMeshStreams::GPUMeshStreams(size_t maxVerts, size_t maxIndices)
   glNamedBufferStorage(VertexStream, 8 * sizeof(float) * maxVerts + sizeof(unsigned int) * 4, nullptr, 0);
   glNamedBufferStorage(IndexStream, sizeof(unsigned int) * maxIndices + sizeof(unsigned int) * 1, nullptr, 0);
 
+  // DrawElementsIndirectCommand: the count is filled in on the GPU, the indices start after
+  // the counter.
+  const GLuint drawCommand[5] = { 0, 1, 1, 0, 0 };
+  glCreateBuffers(1, &DrawCommand);
+  glNamedBufferStorage(DrawCommand, sizeof(drawCommand), drawCommand, 0);
+
   // Setup VAO.
   glGenVertexArrays(1, &VAO);
   glBindVertexArray(VAO);
@@ -498,6 +510,7 @@ GPUMeshStreams::~GPUMeshStreams()
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VertexStream);
   glDeleteBuffers(1, &IndexStream);
+  glDeleteBuffers(1, &DrawCommand);
 }
 
 void GPUMeshStreams::reset()
@@ -515,79 +528,407 @@ void GPUMeshStreams::bind(int vertex, int index)
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, IndexStream);
 }
 
-GLuint GPUMeshStreams::getNumGeneratedElements()
+void GPUMeshStreams::updateDrawCommand()
 {
-  glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
-  GLuint numElements = 0;
-  glGetNamedBufferSubData(IndexStream, 0, sizeof(GLuint), &numElements);
-  return numElements;
+  glCopyNamedBufferSubData(IndexStream, DrawCommand, 0, 0, sizeof(GLuint));
 }
 
-//void GPUMeshStreams::updateIndirectBuffer()
-//{
-//  glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
-//}
+void GPUMeshStreams::draw()
+{
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, DrawCommand);
+  glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
 
-void GPUMeshStreams::draw(int numElements)
+void GPUMeshStreams::drawPulled(int vertex, int index)
 {
+  bind(vertex, index);
+
+  // Read as a DrawArraysIndirectCommand the same buffer is { count, 1, first = 1, 0 }, so
+  // the vertex ids run over the indices after their counter.
   glBindVertexArray(VAO);
-  // glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, 0);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, DrawCommand);
+  glDrawArraysIndirect(GL_TRIANGLES, nullptr);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
 
-  //glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT);
+static std::mutex s_geometryCacheMutex;
+static std::unordered_map<std::string, std::shared_future<std::shared_ptr<const ParsedGeometry>>> s_geometryCache;
 
-  GLintptr offset = 4;
-  glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, (void*)(offset));
+std::shared_ptr<const ParsedGeometry> GeometryCache::acquire(const std::string& file)
+{
+  std::promise<std::shared_ptr<const ParsedGeometry>> promise;
+  std::shared_future<std::shared_ptr<const ParsedGeometry>> pending;
+  bool bOwner = false;
+  {
+    std::lock_guard<std::mutex> lock(s_geometryCacheMutex);
+    auto found = s_geometryCache.find(file);
+    if (found != s_geometryCache.end())
+    {
+      pending = found->second;
+    }
+    else
+    {
+      pending = promise.get_future().share();
+      s_geometryCache[file] = pending;
+      bOwner = true;
+    }
+  }
+
+  // Another loader owns the parse, wait for it.
+  if (!bOwner)
+    return pending.get();
+
+  ArenaCounter scratch;
+  std::shared_ptr<ParsedGeometry> geometry = std::make_shared<ParsedGeometry>();
+  if (ObjReader::load(file, geometry->parts, false, &scratch))
+  {
+    for (MeshPartData& part : geometry->parts)
+      MeshTangents::generate(part, &scratch);
+
+#ifdef OPTIMIZE_MESH_PARTS
+    MeshOptimizer::optimize(geometry->parts, file, &scratch);
+#endif // OPTIMIZE_MESH_PARTS
+
+    std::cout << std::format("GeometryCache::acquire> {}: peak scratch {} KB\n", file, scratch.peakBytes() / 1024);
+  }
+  else
+  {
+    geometry.reset();
+  }
+
+  promise.set_value(geometry);
+  return geometry;
+}
+
+void GeometryCache::clear()
+{
+  std::lock_guard<std::mutex> lock(s_geometryCacheMutex);
+  s_geometryCache.clear();
+}
+
+MeshLoadData::MeshLoadData()
+  : arena(&scratch)
+  , views(arena.resource())
+  , triangleStorage(arena.resource())
+{
+}
+
+MeshLoadData::~MeshLoadData()
+{
 }
 
 Mesh::Mesh(const std::string& path)
+  : m_VAO(0)
+  , m_VBO(0)
+  , m_EBO(0)
+  , m_indexType(GL_UNSIGNED_INT)
+  , m_positionScale(1.f)
+  , m_positionOffset(0.f)
+  , m_indirectBuffer(0)
+  , m_materialStatus(MaterialArrays::Status::Pending)
 {
   loadFromFile(path);
 }
 
+Mesh::Mesh(const MeshLoadData& data)
+  : m_VAO(0)
+  , m_VBO(0)
+  , m_EBO(0)
+  , m_indexType(GL_UNSIGNED_INT)
+  , m_positionScale(1.f)
+  , m_positionOffset(0.f)
+  , m_indirectBuffer(0)
+  , m_materialStatus(MaterialArrays::Status::Pending)
+{
+  create(data);
+}
+
 Mesh::~Mesh()
 {
   m_parts.clear();
+
+  if (m_VAO)
+    glDeleteVertexArrays(1, &m_VAO);
+
+  GLuint buffers[] = { m_VBO, m_EBO, m_indirectBuffer };
+  glDeleteBuffers(3, buffers);
 }
 
 void Mesh::loadFromFile(const std::string& file)
 {
-  std::string materialsPath = std::filesystem::path(file).parent_path().string();
+  MeshLoadData data;
+  if (!prepare(file, data))
+    exit(-1);
+
+  create(data);
+}
+
+bool Mesh::prepare(const std::string& file, MeshLoadData& data)
+{
+  data.file = file;
+
+  data.cache = std::make_unique<MeshCache>();
+  if (data.cache->open(file, MeshCacheKind::Mesh))
+  {
+    for (size_t iPart = 0; iPart < data.cache->numParts(); ++iPart)
+      data.views.push_back(data.cache->getPart(iPart));
+    return true;
+  }
+  data.cache.reset();
+
+  data.geometry = GeometryCache::acquire(file);
+  if (!data.geometry)
+    return false;
+
+  for (const MeshPartData& part : data.geometry->parts)
+    data.views.push_back(part);
+
+  MeshCache::write(file, MeshCacheKind::Mesh, data.geometry->parts, {});
+  return true;
+}
+
+void Mesh::create(const MeshLoadData& data)
+{
+  // One quantization range for the whole mesh keeps positions on shared edges identical.
+  MeshBounds bounds;
+  for (const MeshPartView& view : data.views)
+  {
+    for (const MeshVertex& vtx : view.vtx)
+      bounds.add(vtx.position);
+  }
 
-  tinyobj::ObjReaderConfig reader_config;
-  //reader_config.mtl_search_path = "./"; // Path to material files
+  createBuffers(data.views, bounds, data.arena.resource());
 
-  tinyobj::ObjReader reader;
+  struct DrawElementsIndirectCommand
+  {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  // Empty parts keep a zero-count command so draw ids stay part indices.
+  std::pmr::vector<DrawElementsIndirectCommand> commands(data.arena.resource());
+  commands.reserve(data.views.size());
 
-  if (!reader.ParseFromFile(file, reader_config))
+  GLuint firstIndex = 0;
+  GLint baseVertex = 0;
+  m_parts.reserve(data.views.size());
+  for (size_t iPart = 0; iPart < data.views.size(); ++iPart)
   {
-    if (!reader.Error().empty())
+    const MeshPartView& view = data.views[iPart];
+    m_parts.emplace_back(view, m_VAO, firstIndex, baseVertex, m_indexType, data.arena.resource());
+    commands.push_back({ m_parts.back().numElements, 1, firstIndex, baseVertex, 0 });
+
+    if (!view.vtx.empty())
     {
-      std::cerr << "TinyObjReader: " << reader.Error();
+      firstIndex += (GLuint)view.idx.size();
+      baseVertex += (GLint)view.vtx.size();
     }
-    exit(-1);
   }
 
-  if (!reader.Warning().empty())
+  if (m_VAO && !commands.empty())
   {
-    std::cout << "TinyObjReader: " << reader.Warning();
+    glCreateBuffers(1, &m_indirectBuffer);
+    glNamedBufferStorage(m_indirectBuffer, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), 0);
   }
+}
+
+void Mesh::createBuffers(std::span<const MeshPartView> views, const MeshBounds& bounds, std::pmr::memory_resource* scratch)
+{
+  // Parts without vertices draw nothing, their indices are left out.
+  size_t numVertices = 0;
+  size_t numIndices = 0;
+  size_t maxPartVertices = 0;
+  for (const MeshPartView& view : views)
+  {
+    if (view.vtx.empty())
+      continue;
+
+    numVertices += view.vtx.size();
+    numIndices += view.idx.size();
+    maxPartVertices = std::max(maxPartVertices, view.vtx.size());
+  }
+
+  if (numVertices == 0 || numIndices == 0)
+    return;
+
+  // Part indices are offset by baseVertex, so they stay 16-bit when every part fits.
+  m_indexType = maxPartVertices <= std::numeric_limits<uint16_t>::max() + 1 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 
-  // Create buffers.
+  glGenVertexArrays(1, &m_VAO);
+  glBindVertexArray(m_VAO);
 
-  std::vector<MeshPartData> partData;
-  loadParts(reader, partData, materialsPath);
+  size_t size;
+  size_t offset = 0;
+
+  // init EBO
+  glGenBuffers(1, &m_EBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+  if (m_indexType == GL_UNSIGNED_SHORT)
+  {
+    std::pmr::vector<uint16_t> indices(scratch);
+    indices.reserve(numIndices);
+    for (const MeshPartView& view : views)
+    {
+      if (!view.vtx.empty())
+        indices.insert(indices.end(), view.idx.begin(), view.idx.end());
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), (void*)indices.data(), GL_STATIC_DRAW);
+  }
+  else
+  {
+    std::pmr::vector<unsigned int> indices(scratch);
+    indices.reserve(numIndices);
+    for (const MeshPartView& view : views)
+    {
+      if (!view.vtx.empty())
+        indices.insert(indices.end(), view.idx.begin(), view.idx.end());
+    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), (void*)indices.data(), GL_STATIC_DRAW);
+  }
 
-  // Finalize parts.
-  for (int iPart = 0; iPart < partData.size(); ++iPart)
+#ifdef COMPACT_VERTEX_FORMAT
+
+#ifdef QUANTIZED_POSITIONS
+  if (!bounds.isEmpty())
   {
-    CalcTangents(partData[iPart]);
+    m_positionOffset = (bounds.min + bounds.max) * 0.5f;
+    m_positionScale = glm::max((bounds.max - bounds.min) * 0.5f, glm::vec3(1e-6f));
+  }
+#endif // QUANTIZED_POSITIONS
 
-    m_parts.emplace_back(partData[iPart]);
+  std::pmr::vector<CompactMeshVertex> vertices(scratch);
+  vertices.reserve(numVertices);
+  for (const MeshPartView& view : views)
+  {
+    for (const MeshVertex& vtx : view.vtx)
+      vertices.push_back(packMeshVertex(vtx, m_positionScale, m_positionOffset));
   }
+
+  // init VBO
+  glGenBuffers(1, &m_VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(CompactMeshVertex), (void*)vertices.data(), GL_STATIC_DRAW);
+
+  // Setup VAO:
+  // position
+  glEnableVertexAttribArray(0);
+#ifdef QUANTIZED_POSITIONS
+  size = 4 * sizeof(int16_t);
+  glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(CompactMeshVertex), (void*)offset);
+#else
+  size = 3 * sizeof(float);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CompactMeshVertex), (void*)offset);
+#endif // QUANTIZED_POSITIONS
+  offset += size;
+
+  // normal and tangent, decoded in the shader
+  size = 4 * sizeof(int16_t);
+  glEnableVertexAttribArray(1);
+  glVertexAttribIPointer(1, 4, GL_SHORT, sizeof(CompactMeshVertex), (void*)offset);
+  offset += size;
+
+  // uv
+  size = sizeof(uint32_t);
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactMeshVertex), (void*)offset);
+  offset += size;
+
+#else // !COMPACT_VERTEX_FORMAT
+
+  std::pmr::vector<MeshVertex> vertices(scratch);
+  vertices.reserve(numVertices);
+  for (const MeshPartView& view : views)
+    vertices.insert(vertices.end(), view.vtx.begin(), view.vtx.end());
+
+  // init VBO
+  glGenBuffers(1, &m_VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), (void*)vertices.data(), GL_STATIC_DRAW);
+
+  // Setup VAO:
+  // position
+  size = 3 * sizeof(float);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offset);
+  offset += size;
+
+  // normal
+  size = 3 * sizeof(float);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offset);
+  offset += size;
+
+#ifdef TANGENT_BASIS
+  size = 4 * sizeof(float);
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offset);
+  offset += size;
+#endif // TANGENT_BASIS
+
+  // uv
+  size = 2 * sizeof(float);
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offset);
+  offset += size;
+
+#endif // !COMPACT_VERTEX_FORMAT
+
+  glBindVertexArray(0);
+}
+
+bool Mesh::updateMaterials()
+{
+#ifdef BATCHED_MESH_DRAW
+  if (m_materialStatus != MaterialArrays::Status::Pending || !m_indirectBuffer)
+    return isBatched();
+
+  std::vector<std::shared_ptr<Texture>> textures;
+  textures.reserve(m_parts.size());
+  for (const MeshPart& part : m_parts)
+    textures.push_back(part.diffuseTex);
+
+  m_materialStatus = m_materials.build(textures);
+
+  // The arrays hold copies of the textures, drop the parts' references so they are not
+  // resident twice.
+  if (m_materialStatus == MaterialArrays::Status::Ready)
+  {
+    for (MeshPart& part : m_parts)
+      part.diffuseTex.reset();
+  }
+#endif // BATCHED_MESH_DRAW
+
+  return isBatched();
+}
+
+void Mesh::bindPositionTransform() const
+{
+#ifdef QUANTIZED_POSITIONS
+  // Attributes 4 and 5 have no array bound, so these are constant over the draw.
+  glVertexAttrib3fv(4, &m_positionScale.x);
+  glVertexAttrib3fv(5, &m_positionOffset.x);
+#endif // QUANTIZED_POSITIONS
 }
 
 void Mesh::draw() const
 {
+  bindPositionTransform();
+
+  if (isBatched())
+  {
+    m_materials.bind(0);
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, m_indexType, nullptr, (GLsizei)m_parts.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return;
+  }
+
   for (const MeshPart& part : m_parts)
   {
     if (part.numElements == 0)
@@ -597,8 +938,48 @@ void Mesh::draw() const
   }
 }
 
+void Mesh::drawGeometry() const
+{
+  bindPositionTransform();
+
+#ifdef BATCHED_MESH_DRAW
+  // Without materials every part goes in one draw right away, as for patches.
+  if (m_indirectBuffer)
+  {
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, m_indexType, nullptr, (GLsizei)m_parts.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return;
+  }
+#endif // BATCHED_MESH_DRAW
+
+  for (const MeshPart& part : m_parts)
+  {
+    if (part.numElements == 0)
+      continue;
+
+    part.drawGeometry();
+  }
+}
+
 void Mesh::drawPatches() const
 {
+  bindPositionTransform();
+
+#ifdef BATCHED_MESH_DRAW
+  // Patches need no materials, every part goes in one draw right away.
+  if (m_indirectBuffer)
+  {
+    glPatchParameteri(GL_PATCH_VERTICES, 3);
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+    glMultiDrawElementsIndirect(GL_PATCHES, m_indexType, nullptr, (GLsizei)m_parts.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return;
+  }
+#endif // BATCHED_MESH_DRAW
+
   for (const MeshPart& part : m_parts)
   {
     if (part.numElements == 0)
@@ -620,44 +1001,60 @@ void Mesh::drawNormalVectors() const
 }
 
 
+
 TargetMesh::TargetMesh(const std::string& file)
 {
   loadFromFile(file);
 }
 
+TargetMesh::TargetMesh(const MeshLoadData& data)
+{
+  create(data);
+}
+
 TargetMesh::~TargetMesh()
 {
 }
 
 void TargetMesh::loadFromFile(const std::string& file)
 {
-  tinyobj::ObjReaderConfig reader_config;
-  tinyobj::ObjReader reader;
-
-  if (!reader.ParseFromFile(file, reader_config))
-  {
-    if (!reader.Error().empty())
-    {
-      std::cerr << "TinyObjReader: " << reader.Error();
-    }
+  MeshLoadData data;
+  if (!prepare(file, data))
     exit(-1);
-  }
 
-  if (!reader.Warning().empty())
+  create(data);
+}
+
+bool TargetMesh::prepare(const std::string& file, MeshLoadData& data)
+{
+  data.file = file;
+
+  data.cache = std::make_unique<MeshCache>();
+  if (data.cache->open(file, MeshCacheKind::Target))
   {
-    std::cout << "TinyObjReader: " << reader.Warning();
+    data.triangles = data.cache->getTriangles();
+    return true;
   }
+  data.cache.reset();
 
-  std::vector<MeshPartData> partData;
-  loadParts(reader, partData, "", true);
+  // Share the parse with the tessellation mesh; the triangle stream spans every material's part.
+  data.geometry = GeometryCache::acquire(file);
+  if (!data.geometry)
+    return false;
 
-  if (partData.size() != 1)
-  {
-    std::cerr << "Failed to load target mesh.\n";
+  TargetGeometryStream::buildTriangles(data.geometry->parts, data.triangleStorage);
+  data.triangles = data.triangleStorage;
+
+  MeshCache::write(file, MeshCacheKind::Target, {}, data.triangles);
+  return true;
+}
+
+void TargetMesh::create(const MeshLoadData& data)
+{
+  if (data.triangles.empty())
     return;
-  }
 
-  triStream = TargetGeometryStream(partData[0]);
+  triStream = TargetGeometryStream(data.triangles);
 }
 
 TileMesh::TileMesh(const std::string& file)
@@ -665,39 +1062,61 @@ TileMesh::TileMesh(const std::string& file)
   loadFromFile(file);
 }
 
+TileMesh::TileMesh(const MeshLoadData& data)
+{
+  create(data);
+}
+
 TileMesh::~TileMesh()
 {
 }
 
 void TileMesh::loadFromFile(const std::string& file)
 {
-  tinyobj::ObjReaderConfig reader_config;
-  tinyobj::ObjReader reader;
-
-  if (!reader.ParseFromFile(file, reader_config))
-  {
-    if (!reader.Error().empty())
-    {
-      std::cerr << "TinyObjReader: " << reader.Error();
-    }
+  MeshLoadData data;
+  if (!prepare(file, data))
     exit(-1);
-  }
 
-  if (!reader.Warning().empty())
+  create(data);
+}
+
+bool TileMesh::prepare(const std::string& file, MeshLoadData& data)
+{
+  data.file = file;
+
+  data.cache = std::make_unique<MeshCache>();
+  if (data.cache->open(file, MeshCacheKind::Tile) && data.cache->numParts() == 1)
   {
-    std::cout << "TinyObjReader: " << reader.Warning();
+    data.views.push_back(data.cache->getPart(0));
+    return true;
   }
+  data.cache.reset();
 
-  std::vector<MeshPartData> partData;
-  loadParts(reader, partData, "", true);
+  if (!ObjReader::load(file, data.parts, true, &data.scratch))
+    return false;
 
-  if (partData.size() != 1)
+  if (data.parts.size() != 1)
   {
     std::cerr << "Failed to load tile mesh.\n";
-    return;
+    return true;
   }
 
-  tileStreams = TileGeometryStreams(partData[0]);
-  numVerts = partData[0].vtx.size();
-  numIndices = partData[0].idx.size();
+#ifdef OPTIMIZE_MESH_PARTS
+  MeshOptimizer::optimize(data.parts, file, &data.scratch);
+#endif // OPTIMIZE_MESH_PARTS
+
+  data.views.push_back(data.parts[0]);
+
+  MeshCache::write(file, MeshCacheKind::Tile, data.parts, {});
+  return true;
 }
+
+void TileMesh::create(const MeshLoadData& data)
+{
+  if (data.views.size() != 1)
+    return;
+
+  tileStreams = TileGeometryStreams(data.views[0], data.arena.resource());
+  numVerts = data.views[0].vtx.size();
+  numIndices = data.views[0].idx.size();
+}
\ No newline at end of file
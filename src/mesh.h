@@ -6,11 +6,30 @@
 #include <unordered_map>
 #include <tuple>
 #include <memory>
+#include <vector>
+#include <span>
+#include <limits>
+#include <cstdint>
+#include <memory_resource>
 #include "texture.h"
+#include "materialarrays.h"
+#include "loadarena.h"
 
 #define TILEMESH_UVS
 #define TANGENT_BASIS
 
+// Reorder mesh parts for the vertex cache and fetch locality after loading.
+#define OPTIMIZE_MESH_PARTS
+
+// Upload static meshes with octahedral normals and tangents, half-float uvs and 16-bit
+// indices where they fit. QUANTIZED_POSITIONS also stores positions as snorm16.
+#define COMPACT_VERTEX_FORMAT
+// #define QUANTIZED_POSITIONS
+
+// Draw whole meshes with one glMultiDrawElementsIndirect once their materials are packed
+// into texture arrays; shaders pick the texture by gl_DrawID.
+#define BATCHED_MESH_DRAW
+
 struct MeshVertex
 {
   glm::vec3 position;
@@ -36,24 +55,35 @@ struct MeshVertexPadded
   float padding3;
 };
 
-struct MeshIndexKey
+#ifdef COMPACT_VERTEX_FORMAT
+// GPU layout of MeshPart vertices. `frame` holds the octahedral normal and tangent as
+// snorm16 pairs, with the bitangent sign in the lowest bit of the last component.
+struct CompactMeshVertex
 {
-  int posIdx;
-  int normalIdx;
-  int uvIdx;
+#ifdef QUANTIZED_POSITIONS
+  int16_t position[4];
+#else
+  glm::vec3 position;
+#endif // QUANTIZED_POSITIONS
 
-  bool operator==(const MeshIndexKey&) const = default;
+  int16_t frame[4];
+  uint32_t uv; // half2
 };
+#endif // COMPACT_VERTEX_FORMAT
 
-template <>
-struct std::hash<MeshIndexKey>
+// Axis-aligned bounds, used as the position dequantization range.
+struct MeshBounds
 {
-  std::size_t operator()(const MeshIndexKey& k) const noexcept
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+  inline void add(const glm::vec3& p)
   {
-    return hash<int>()(k.posIdx)
-      ^ (hash<int>()(k.normalIdx) << 1)
-      ^ (hash<int>()(k.uvIdx) << 2);
+    min = glm::min(min, p);
+    max = glm::max(max, p);
   }
+
+  inline bool isEmpty() const { return min.x > max.x; }
 };
 
 struct MeshPartData
@@ -61,24 +91,39 @@ struct MeshPartData
   std::vector<MeshVertex> vtx;
   std::vector<unsigned int> idx;
   std::string diffuseTex;
-  std::unordered_map<MeshIndexKey, int> idxToVtxCache;
 };
 
+// Non-owning view of finished part geometry, either from MeshPartData or a mapped cache file.
+struct MeshPartView
+{
+  std::span<const MeshVertex> vtx;
+  std::span<const unsigned int> idx;
+  std::string diffuseTex;
+
+  MeshPartView() { }
+  MeshPartView(const MeshPartData& data) : vtx(data.vtx), idx(data.idx), diffuseTex(data.diffuseTex) { }
+};
+
+// One material's range of its Mesh's vertex and index buffers. Indices are local to the
+// part and offset by baseVertex.
 class MeshPart
 {
 public:
-  GLuint VAO;
-  GLuint VBO;
-  GLuint EBO;
+  GLuint VAO; // owned by the Mesh
+  GLuint firstIndex;
+  GLint baseVertex;
   GLuint numElements;
-  std::unique_ptr<Texture> diffuseTex;
+  GLenum indexType;
+  std::shared_ptr<Texture> diffuseTex;
 
   GLuint debugLine_VAO;
   GLuint debugLine_VBO;
   GLuint numDebugLineVerts;
 
-  MeshPart() : VAO(0), VBO(0), EBO(0), numElements(0), debugLine_VAO(0), debugLine_VBO(0), numDebugLineVerts(0) { }
-  MeshPart(const MeshPartData& data);
+  MeshPart() : VAO(0), firstIndex(0), baseVertex(0), numElements(0), indexType(GL_UNSIGNED_INT), debugLine_VAO(0), debugLine_VBO(0), numDebugLineVerts(0) { }
+  // Upload copies are made in `scratch`.
+  MeshPart(const MeshPartView& data, GLuint VAO, GLuint firstIndex, GLint baseVertex, GLenum indexType,
+    std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
   ~MeshPart();
 
   inline MeshPart(MeshPart&& rhs) noexcept;
@@ -89,13 +134,29 @@ public:
   MeshPart& operator=(const MeshPart&) = delete;
 
   void draw() const;
+  // Triangles without binding the part's material, for programs that bring their own.
+  void drawGeometry() const;
   void drawPatches() const;
   void drawNormalVectors() const;
+
+protected:
+  inline const void* indexOffset() const { return (const void*)(firstIndex * (size_t)(indexType == GL_UNSIGNED_SHORT ? 2 : 4)); }
 };
 
 class TargetGeometryStream
 {
 public:
+  // Target primitives. Quads whose uvs span an axis-aligned rectangle are kept whole and
+  // tiled bilinearly; every other face is split into triangles.
+  enum class PrimitiveType : int
+  {
+    Triangle = 0,
+    Quad = 1,
+  };
+
+  // One target primitive. For quads the corners are ordered by uv (min/min, max/min,
+  // max/max, min/max) and uvToBary0/1/2 hold the uv min, the inverse uv extent and the
+  // uv max in xy.
   struct Triangle
   {
     glm::vec3 p0;
@@ -130,6 +191,11 @@ public:
     glm::vec3 n2;
     float padding7;
 
+    glm::vec3 p3;
+    int primitiveType;
+
+    glm::vec3 n3;
+    float padding8;
 
     // glm::mat3 uvToBary;
   };
@@ -138,9 +204,11 @@ public:
   size_t numElements;
 
   TargetGeometryStream() : TriangleStream(0), numElements(0) { }
-  TargetGeometryStream(const MeshPartData& data);
+  TargetGeometryStream(std::span<const Triangle> triangles);
   ~TargetGeometryStream();
-  
+
+  static void buildTriangles(std::span<const MeshPartData> parts, std::pmr::vector<Triangle>& stream);
+
   void bind(int target) const;
 
   inline TargetGeometryStream(TargetGeometryStream&& rhs) noexcept;
@@ -159,6 +227,17 @@ protected:
   GLuint IndexStream;
 
 public:
+#ifdef COMPACT_VERTEX_FORMAT
+  // Matches PackedVertex in tilegen.glsl.
+  struct Vertex
+  {
+    glm::vec3 position;
+    uint32_t normal; // octahedral snorm16x2
+#ifdef TILEMESH_UVS
+    uint32_t uv; // half2
+#endif // TILEMESH_UVS
+  };
+#else // !COMPACT_VERTEX_FORMAT
   struct Vertex
   {
     glm::vec3 position;
@@ -171,9 +250,10 @@ public:
     float padding3;
 #endif // TILEMESH_UVS
   };
+#endif // !COMPACT_VERTEX_FORMAT
 
   TileGeometryStreams() : VertexStream(0), IndexStream(0) { }
-  TileGeometryStreams(const MeshPartData& data);
+  TileGeometryStreams(const MeshPartView& data, std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
   ~TileGeometryStreams();
 
   void bind(int vertex, int index) const;
@@ -186,41 +266,132 @@ public:
   TileGeometryStreams& operator=(const TileGeometryStreams&) = delete;
 };
 
+// Geometry written by tilegen.glsl. Each stream starts with its atomic counter, the
+// index count is copied on the GPU into an indirect draw command so drawing never reads
+// it back.
 class GPUMeshStreams
 {
 protected:
   GLuint VertexStream;
   GLuint IndexStream;
+  GLuint DrawCommand;
   GLuint VAO;
 
 public:
-  GPUMeshStreams() : VertexStream(0), IndexStream(0), VAO(0) { }
+  GPUMeshStreams() : VertexStream(0), IndexStream(0), DrawCommand(0), VAO(0) { }
   GPUMeshStreams(size_t maxVerts, size_t maxIndices);
   ~GPUMeshStreams();
 
   void reset();
   void bind(int vertex, int index);
-  GLuint getNumGeneratedElements();
-  void draw(int numElements);
+  // Copies the generated index count into the draw command.
+  void updateDrawCommand();
+  void draw();
+  // Draws without the VAO's attributes and indices, the vertex shader reads the streams
+  // bound at `vertex` and `index` itself. Every triangle corner becomes its own vertex.
+  void drawPulled(int vertex, int index);
 
   // delete copy constructor
   GPUMeshStreams(const GPUMeshStreams&) = delete;
   GPUMeshStreams& operator=(const GPUMeshStreams&) = delete;
 };
 
+class MeshCache;
+
+// Parsed OBJ geometry split by material with tangents, shared by every loader that
+// needs the same file so it is only parsed once.
+struct ParsedGeometry
+{
+  std::vector<MeshPartData> parts;
+};
+
+class GeometryCache
+{
+public:
+  // Parse `file`, or wait for and share a parse already in flight on another thread.
+  // Returns nullptr if the file fails to parse.
+  static std::shared_ptr<const ParsedGeometry> acquire(const std::string& file);
+
+  // Drop all cached geometry once loading is done.
+  static void clear();
+};
+
+// CPU-side result of loading a mesh file, produced off the GL thread and consumed by
+// Mesh/TargetMesh/TileMesh::create on the GL thread.
+struct MeshLoadData
+{
+  std::string file;
+
+  // Scratch for this load's temporaries on both stages, freed with the load data.
+  ArenaCounter scratch;
+  mutable LoadArena arena;
+
+  // Mapped cache file on a warm start.
+  std::unique_ptr<MeshCache> cache;
+
+  // Parsed geometry on a cold start.
+  std::shared_ptr<const ParsedGeometry> geometry;
+  std::vector<MeshPartData> parts;
+
+  // Finished part geometry, pointing into either of the above.
+  std::pmr::vector<MeshPartView> views;
+  std::span<const TargetGeometryStream::Triangle> triangles;
+  std::pmr::vector<TargetGeometryStream::Triangle> triangleStorage;
+
+  MeshLoadData();
+  ~MeshLoadData();
+
+  // delete copy constructor
+  MeshLoadData(const MeshLoadData&) = delete;
+  MeshLoadData& operator=(const MeshLoadData&) = delete;
+};
+
 class Mesh
 {
 protected:
   std::vector<MeshPart> m_parts;
 
+  // Vertices and indices of every part.
+  GLuint m_VAO;
+  GLuint m_VBO;
+  GLuint m_EBO;
+  GLenum m_indexType;
+
+  // Maps snorm16 positions back to object space with QUANTIZED_POSITIONS.
+  glm::vec3 m_positionScale;
+  glm::vec3 m_positionOffset;
+
+  // One DrawElementsIndirectCommand per part, in part order so gl_DrawID is the part index.
+  GLuint m_indirectBuffer;
+  MaterialArrays m_materials;
+  MaterialArrays::Status m_materialStatus;
+
 public:
   Mesh(const std::string& file);
+  Mesh(const MeshLoadData& data);
   ~Mesh();
 
+  // delete copy constructor
+  Mesh(const Mesh&) = delete;
+  Mesh& operator=(const Mesh&) = delete;
+
 
   void loadFromFile(const std::string& file);
 
+  // CPU stage, safe to call from any thread.
+  static bool prepare(const std::string& file, MeshLoadData& data);
+  // GL stage.
+  void create(const MeshLoadData& data);
+
+  // Pack the part textures into arrays once they have streamed in. Returns true when
+  // draw() issues one batched draw, which needs a program reading materials through
+  // gl_DrawID; until then draw() binds each part's texture to unit 0.
+  bool updateMaterials();
+  inline bool isBatched() const { return m_materialStatus == MaterialArrays::Status::Ready; }
+
   void draw() const;
+  // Triangles without binding the part's material, for programs that bring their own.
+  void drawGeometry() const;
   void drawPatches() const;
   void drawNormalVectors() const;
 
@@ -231,6 +402,10 @@ public:
       elem += part.numElements;
     return elem;
   }
+
+protected:
+  void createBuffers(std::span<const MeshPartView> views, const MeshBounds& bounds, std::pmr::memory_resource* scratch);
+  void bindPositionTransform() const;
 };
 
 class TargetMesh
@@ -240,10 +415,16 @@ protected:
 
 public:
   TargetMesh(const std::string& file);
+  TargetMesh(const MeshLoadData& data);
   ~TargetMesh();
 
   void loadFromFile(const std::string& file);
 
+  // CPU stage, safe to call from any thread.
+  static bool prepare(const std::string& file, MeshLoadData& data);
+  // GL stage.
+  void create(const MeshLoadData& data);
+
   inline void bindGeometryStream(int target) const { triStream.bind( target ); }
   inline size_t numTriangles() const { return triStream.numElements; }
 };
@@ -257,10 +438,16 @@ protected:
 
 public:
   TileMesh(const std::string& file);
+  TileMesh(const MeshLoadData& data);
   ~TileMesh();
 
   void loadFromFile(const std::string& file);
 
+  // CPU stage, safe to call from any thread.
+  static bool prepare(const std::string& file, MeshLoadData& data);
+  // GL stage.
+  void create(const MeshLoadData& data);
+
   inline unsigned int getNumVerts() const { return numVerts; }
   inline unsigned int getNumIndices() const { return numIndices; }
   inline void bindGeometryStreams(int vertex, int index) const { tileStreams.bind(vertex, index); }
@@ -270,17 +457,16 @@ public:
 
 MeshPart::MeshPart(MeshPart&& rhs) noexcept
   : VAO(rhs.VAO)
-  , VBO(rhs.VBO)
-  , EBO(rhs.EBO)
+  , firstIndex(rhs.firstIndex)
+  , baseVertex(rhs.baseVertex)
   , numElements(rhs.numElements)
+  , indexType(rhs.indexType)
   , diffuseTex(std::move(rhs.diffuseTex))
   , debugLine_VAO(rhs.debugLine_VAO)
   , debugLine_VBO(rhs.debugLine_VBO)
   , numDebugLineVerts(rhs.numDebugLineVerts)
 {
   rhs.VAO = 0;
-  rhs.VBO = 0;
-  rhs.EBO = 0;
   rhs.numElements = 0;
   rhs.debugLine_VAO = 0;
   rhs.debugLine_VBO = 0;
@@ -292,15 +478,14 @@ MeshPart& MeshPart::operator=(MeshPart&& rhs) noexcept
   VAO = rhs.VAO;
   rhs.VAO = 0;
 
-  VBO = rhs.VBO;
-  rhs.VBO = 0;
-
-  EBO = rhs.EBO;
-  rhs.EBO = 0;
+  firstIndex = rhs.firstIndex;
+  baseVertex = rhs.baseVertex;
 
   numElements = rhs.numElements;
   rhs.numElements = 0;
 
+  indexType = rhs.indexType;
+
   diffuseTex = std::move(rhs.diffuseTex);
 
   debugLine_VAO = rhs.debugLine_VAO;
@@ -0,0 +1,281 @@
+#include "meshcache.h"
+#include "meshoptimizer.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <format>
+#include <cstddef>
+
+#ifndef MESH_CACHE_DIR
+#define MESH_CACHE_DIR "cache"
+#endif // MESH_CACHE_DIR
+
+static const uint32_t MESH_CACHE_MAGIC = 0x4348534D; // 'MSHC'
+static const uint32_t MESH_CACHE_VERSION = 3;
+static const size_t MESH_CACHE_ALIGN = 16;
+
+static uint64_t fnv1a(const void* data, size_t len, uint64_t hash = 0xcbf29ce484222325ull)
+{
+  const unsigned char* bytes = (const unsigned char*)data;
+  for (size_t i = 0; i < len; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static uint64_t fnv1a(uint64_t value, uint64_t hash)
+{
+  return fnv1a(&value, sizeof(value), hash);
+}
+
+static inline uint64_t alignOffset(uint64_t offset)
+{
+  return (offset + (MESH_CACHE_ALIGN - 1)) & ~(uint64_t)(MESH_CACHE_ALIGN - 1);
+}
+
+static std::string canonicalSource(const std::string& source)
+{
+  std::error_code ec;
+  std::filesystem::path path = std::filesystem::weakly_canonical(source, ec);
+  if (ec)
+    return source;
+  return path.generic_string();
+}
+
+static int64_t sourceTime(const std::string& source)
+{
+  std::error_code ec;
+  auto time = std::filesystem::last_write_time(source, ec);
+  if (ec)
+    return 0;
+  return (int64_t)time.time_since_epoch().count();
+}
+
+uint64_t MeshCache::layoutHash()
+{
+  uint64_t hash = fnv1a(MESH_CACHE_VERSION, 0xcbf29ce484222325ull);
+
+  hash = fnv1a(sizeof(MeshVertex), hash);
+  hash = fnv1a(offsetof(MeshVertex, normal), hash);
+#ifdef TANGENT_BASIS
+  hash = fnv1a(offsetof(MeshVertex, tangent), hash);
+#endif // TANGENT_BASIS
+  hash = fnv1a(offsetof(MeshVertex, uv), hash);
+
+#ifdef OPTIMIZE_MESH_PARTS
+  hash = fnv1a(MeshOptimizer::CACHE_SIZE, hash);
+#endif // OPTIMIZE_MESH_PARTS
+
+  hash = fnv1a(sizeof(TargetGeometryStream::Triangle), hash);
+  hash = fnv1a(offsetof(TargetGeometryStream::Triangle, uvToBary0), hash);
+  hash = fnv1a(offsetof(TargetGeometryStream::Triangle, n0), hash);
+  hash = fnv1a(offsetof(TargetGeometryStream::Triangle, primitiveType), hash);
+
+  return hash;
+}
+
+std::string MeshCache::cachePath(const std::string& source, MeshCacheKind kind)
+{
+  std::string key = canonicalSource(source);
+  uint64_t hash = fnv1a(key.data(), key.size());
+  hash = fnv1a((uint64_t)kind, hash);
+
+  std::string name = std::filesystem::path(source).stem().string() + std::format("_{:016x}.meshcache", hash);
+  return (std::filesystem::path(MESH_CACHE_DIR) / name).string();
+}
+
+bool MeshCache::open(const std::string& source, MeshCacheKind kind)
+{
+  close();
+
+  std::string path = cachePath(source, kind);
+  if (!std::filesystem::exists(path) || !m_file.open(path))
+    return false;
+
+  const char* base = (const char*)m_file.data();
+  size_t size = m_file.size();
+
+  const Header* header = (const Header*)base;
+  if (size < sizeof(Header)
+    || header->magic != MESH_CACHE_MAGIC
+    || header->version != MESH_CACHE_VERSION
+    || header->layoutHash != layoutHash()
+    || header->kind != (uint32_t)kind
+    || header->sourceTime != sourceTime(source))
+  {
+    m_file.close();
+    return false;
+  }
+
+  // Guard against hash collisions between source paths.
+  std::string key = canonicalSource(source);
+  if (header->sourcePathOffset + header->sourcePathLen > size
+    || key.size() != header->sourcePathLen
+    || memcmp(base + header->sourcePathOffset, key.data(), key.size()) != 0)
+  {
+    m_file.close();
+    return false;
+  }
+
+  const PartEntry* parts = (const PartEntry*)(base + sizeof(Header));
+  if (sizeof(Header) + sizeof(PartEntry) * header->numParts > size
+    || header->trianglesOffset + header->numTriangles * sizeof(TargetGeometryStream::Triangle) > size)
+  {
+    std::cerr << "MeshCache::open> Truncated cache file: " << path << "\n";
+    m_file.close();
+    return false;
+  }
+
+  for (uint32_t i = 0; i < header->numParts; i++)
+  {
+    if (parts[i].vtxOffset + parts[i].numVtx * sizeof(MeshVertex) > size
+      || parts[i].idxOffset + parts[i].numIdx * sizeof(unsigned int) > size
+      || parts[i].texOffset + parts[i].texLen > size)
+    {
+      std::cerr << "MeshCache::open> Truncated cache file: " << path << "\n";
+      m_file.close();
+      return false;
+    }
+  }
+
+  m_header = header;
+  m_parts = parts;
+  return true;
+}
+
+void MeshCache::close()
+{
+  m_file.close();
+  m_header = nullptr;
+  m_parts = nullptr;
+}
+
+MeshPartView MeshCache::getPart(size_t i) const
+{
+  const char* base = (const char*)m_file.data();
+  const PartEntry& entry = m_parts[i];
+
+  MeshPartView view;
+  view.vtx = std::span<const MeshVertex>((const MeshVertex*)(base + entry.vtxOffset), entry.numVtx);
+  view.idx = std::span<const unsigned int>((const unsigned int*)(base + entry.idxOffset), entry.numIdx);
+  view.diffuseTex = std::string(base + entry.texOffset, entry.texLen);
+  return view;
+}
+
+std::span<const TargetGeometryStream::Triangle> MeshCache::getTriangles() const
+{
+  if (!m_header || m_header->numTriangles == 0)
+    return {};
+
+  const char* base = (const char*)m_file.data();
+  return std::span<const TargetGeometryStream::Triangle>((const TargetGeometryStream::Triangle*)(base + m_header->trianglesOffset), m_header->numTriangles);
+}
+
+bool MeshCache::write(const std::string& source, MeshCacheKind kind, const std::vector<MeshPartData>& parts, std::span<const TargetGeometryStream::Triangle> triangles)
+{
+  std::string path = cachePath(source, kind);
+  std::string key = canonicalSource(source);
+
+  std::error_code ec;
+  std::filesystem::create_directories(MESH_CACHE_DIR, ec);
+
+  // Lay out the file: header, part table, strings, then aligned data blobs.
+  Header header = {};
+  header.magic = MESH_CACHE_MAGIC;
+  header.version = MESH_CACHE_VERSION;
+  header.layoutHash = layoutHash();
+  header.sourceTime = sourceTime(source);
+  header.kind = (uint32_t)kind;
+  header.numParts = (uint32_t)parts.size();
+  header.numTriangles = triangles.size();
+
+  uint64_t offset = sizeof(Header) + sizeof(PartEntry) * parts.size();
+  header.sourcePathOffset = offset;
+  header.sourcePathLen = (uint32_t)key.size();
+  offset += key.size();
+
+  std::vector<PartEntry> entries(parts.size());
+  for (size_t i = 0; i < parts.size(); i++)
+  {
+    entries[i] = {};
+    entries[i].texOffset = offset;
+    entries[i].texLen = (uint32_t)parts[i].diffuseTex.size();
+    offset += parts[i].diffuseTex.size();
+  }
+
+  for (size_t i = 0; i < parts.size(); i++)
+  {
+    offset = alignOffset(offset);
+    entries[i].vtxOffset = offset;
+    entries[i].numVtx = parts[i].vtx.size();
+    offset += parts[i].vtx.size() * sizeof(MeshVertex);
+
+    offset = alignOffset(offset);
+    entries[i].idxOffset = offset;
+    entries[i].numIdx = parts[i].idx.size();
+    offset += parts[i].idx.size() * sizeof(unsigned int);
+  }
+
+  offset = alignOffset(offset);
+  header.trianglesOffset = offset;
+  offset += triangles.size_bytes();
+
+  // Write to a temporary file first so a crash never leaves a half-written cache behind.
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!ofs)
+    {
+      std::cerr << "MeshCache::write> Failed to open " << tmpPath << "\n";
+      return false;
+    }
+
+    uint64_t written = 0;
+    auto put = [&](const void* data, size_t len) {
+      ofs.write((const char*)data, len);
+      written += len;
+    };
+    auto pad = [&](uint64_t to) {
+      static const char zeros[MESH_CACHE_ALIGN] = { 0 };
+      while (written < to)
+        put(zeros, std::min<uint64_t>(to - written, MESH_CACHE_ALIGN));
+    };
+
+    put(&header, sizeof(header));
+    put(entries.data(), entries.size() * sizeof(PartEntry));
+    put(key.data(), key.size());
+    for (const MeshPartData& part : parts)
+      put(part.diffuseTex.data(), part.diffuseTex.size());
+
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+      pad(entries[i].vtxOffset);
+      put(parts[i].vtx.data(), parts[i].vtx.size() * sizeof(MeshVertex));
+      pad(entries[i].idxOffset);
+      put(parts[i].idx.data(), parts[i].idx.size() * sizeof(unsigned int));
+    }
+
+    pad(header.trianglesOffset);
+    put(triangles.data(), triangles.size_bytes());
+
+    if (!ofs)
+    {
+      std::cerr << "MeshCache::write> Failed to write " << tmpPath << "\n";
+      return false;
+    }
+  }
+
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+  {
+    std::cerr << "MeshCache::write> Failed to move cache into place: " << ec.message() << "\n";
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+
+  std::cout << "Wrote mesh cache '" << path << "'\n";
+  return true;
+}
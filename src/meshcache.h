@@ -0,0 +1,80 @@
+#ifndef _MESHCACHE_H
+#define _MESHCACHE_H
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdint>
+#include "mesh.h"
+#include "mappedfile.h"
+
+// Which loader produced the cached geometry. The same OBJ is cached separately
+// per kind since targets and tiles ignore materials.
+enum class MeshCacheKind : uint32_t
+{
+  Mesh,
+  Target,
+  Tile,
+
+  Count
+};
+
+// Versioned binary cache of finished mesh geometry, keyed by source path, source
+// mtime and a hash of the in-memory vertex/triangle layouts. A valid cache file is
+// mapped and its arrays are uploaded to GL directly.
+class MeshCache
+{
+public:
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t layoutHash;
+    int64_t sourceTime;
+    uint32_t kind;
+    uint32_t numParts;
+    uint64_t numTriangles;
+    uint64_t trianglesOffset;
+    uint64_t sourcePathOffset;
+    uint32_t sourcePathLen;
+    uint32_t padding0;
+  };
+
+  struct PartEntry
+  {
+    uint64_t vtxOffset;
+    uint64_t numVtx;
+    uint64_t idxOffset;
+    uint64_t numIdx;
+    uint64_t texOffset;
+    uint32_t texLen;
+    uint32_t padding0;
+  };
+
+protected:
+  MappedFile m_file;
+  const Header* m_header;
+  const PartEntry* m_parts;
+
+public:
+  MeshCache() : m_header(nullptr), m_parts(nullptr) { }
+
+  // Map the cache file for `source`, returns false if missing or stale.
+  bool open(const std::string& source, MeshCacheKind kind);
+  void close();
+
+  inline bool isOpen() const { return m_header != nullptr; }
+  inline size_t numParts() const { return m_header ? m_header->numParts : 0; }
+  MeshPartView getPart(size_t i) const;
+  std::span<const TargetGeometryStream::Triangle> getTriangles() const;
+
+  static bool write(const std::string& source, MeshCacheKind kind, const std::vector<MeshPartData>& parts, std::span<const TargetGeometryStream::Triangle> triangles);
+
+  static uint64_t layoutHash();
+  static std::string cachePath(const std::string& source, MeshCacheKind kind);
+
+  // delete copy constructor
+  MeshCache(const MeshCache&) = delete;
+  MeshCache& operator=(const MeshCache&) = delete;
+};
+
+#endif // _MESHCACHE_H
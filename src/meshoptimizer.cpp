@@ -0,0 +1,193 @@
+#include "meshoptimizer.h"
+#include "threadpool.h"
+#include "loadarena.h"
+#include <iostream>
+#include <format>
+
+size_t MeshOptimizer::countCacheMisses(std::span<const unsigned int> idx, size_t numVertices, std::pmr::memory_resource* scratch)
+{
+  // Cache entry time per vertex, a vertex is resident while it is among the last CACHE_SIZE misses.
+  std::pmr::vector<size_t> cacheTime(numVertices, 0, scratch);
+  size_t time = CACHE_SIZE + 1;
+  size_t misses = 0;
+
+  for (unsigned int v : idx)
+  {
+    if (time - cacheTime[v] > CACHE_SIZE)
+    {
+      cacheTime[v] = time++;
+      misses++;
+    }
+  }
+
+  return misses;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& idx, size_t numVertices, std::pmr::memory_resource* scratch)
+{
+  size_t numTriangles = idx.size() / 3;
+  if (numTriangles == 0)
+    return;
+
+  // Vertex to triangle adjacency, stored compactly.
+  std::pmr::vector<unsigned int> live(numVertices, 0, scratch);
+  for (unsigned int v : idx)
+    live[v]++;
+
+  std::pmr::vector<size_t> adjacencyOffset(numVertices + 1, 0, scratch);
+  for (size_t v = 0; v < numVertices; v++)
+    adjacencyOffset[v + 1] = adjacencyOffset[v] + live[v];
+
+  std::pmr::vector<unsigned int> adjacency(idx.size(), scratch);
+  {
+    std::pmr::vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1, scratch);
+    for (size_t i = 0; i < idx.size(); i++)
+      adjacency[fill[idx[i]]++] = (unsigned int)(i / 3);
+  }
+
+  std::pmr::vector<size_t> cacheTime(numVertices, 0, scratch);
+  std::pmr::vector<bool> emitted(numTriangles, false, scratch);
+  std::pmr::vector<unsigned int> deadEnd(scratch);
+  std::pmr::vector<unsigned int> candidates(scratch);
+  std::pmr::vector<unsigned int> output(scratch);
+  output.reserve(idx.size());
+
+  size_t time = CACHE_SIZE + 1;
+  size_t cursor = 0;
+
+  // Next fanning vertex once the candidates are exhausted: the most recently used
+  // vertex with triangles left, else the next one in input order.
+  auto skipDeadEnd = [&]() -> int {
+    while (!deadEnd.empty())
+    {
+      unsigned int v = deadEnd.back();
+      deadEnd.pop_back();
+      if (live[v] > 0)
+        return (int)v;
+    }
+
+    while (cursor < numVertices)
+    {
+      if (live[cursor] > 0)
+        return (int)cursor;
+      cursor++;
+    }
+
+    return -1;
+  };
+
+  int fanning = skipDeadEnd();
+  while (fanning >= 0)
+  {
+    candidates.clear();
+
+    // Emit every remaining triangle around the fanning vertex.
+    for (size_t i = adjacencyOffset[fanning]; i < adjacencyOffset[fanning + 1]; i++)
+    {
+      unsigned int t = adjacency[i];
+      if (emitted[t])
+        continue;
+
+      for (int corner = 0; corner < 3; corner++)
+      {
+        unsigned int v = idx[3 * t + corner];
+        output.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+
+        if (time - cacheTime[v] > CACHE_SIZE)
+          cacheTime[v] = time++;
+      }
+      emitted[t] = true;
+    }
+
+    // Prefer the oldest candidate that will still be in the cache once its triangles are emitted.
+    int next = -1;
+    size_t bestPriority = 0;
+    bool bFound = false;
+    for (unsigned int v : candidates)
+    {
+      if (live[v] == 0)
+        continue;
+
+      size_t priority = 0;
+      if (time - cacheTime[v] + 2 * live[v] <= CACHE_SIZE)
+        priority = time - cacheTime[v];
+
+      if (!bFound || priority > bestPriority)
+      {
+        bestPriority = priority;
+        next = (int)v;
+        bFound = true;
+      }
+    }
+
+    fanning = (next >= 0) ? next : skipDeadEnd();
+  }
+
+  idx.assign(output.begin(), output.end());
+}
+
+void MeshOptimizer::optimizeVertexFetch(MeshPartData& part, std::pmr::memory_resource* scratch)
+{
+  const unsigned int unused = ~0u;
+  std::pmr::vector<unsigned int> remap(part.vtx.size(), unused, scratch);
+  std::vector<MeshVertex> vtx;
+  vtx.reserve(part.vtx.size());
+
+  for (unsigned int& v : part.idx)
+  {
+    if (remap[v] == unused)
+    {
+      remap[v] = (unsigned int)vtx.size();
+      vtx.push_back(part.vtx[v]);
+    }
+    v = remap[v];
+  }
+
+  part.vtx.swap(vtx);
+}
+
+void MeshOptimizer::optimize(std::vector<MeshPartData>& parts, const std::string& name, ArenaCounter* counter)
+{
+  LoadArena arena(counter);
+  std::pmr::vector<size_t> missesBefore(parts.size(), 0, arena.resource());
+  std::pmr::vector<size_t> missesAfter(parts.size(), 0, arena.resource());
+
+  ThreadPool::global().parallelFor(parts.size(), [&](size_t i) {
+    MeshPartData& part = parts[i];
+    LoadArena partArena(counter);
+    std::pmr::memory_resource* scratch = partArena.resource();
+
+    missesBefore[i] = countCacheMisses(part.idx, part.vtx.size(), scratch);
+
+    // Tipsify is greedy, keep the input order for the rare part it makes worse.
+    std::pmr::vector<unsigned int> original(part.idx.begin(), part.idx.end(), scratch);
+    optimizeVertexCache(part.idx, part.vtx.size(), scratch);
+    missesAfter[i] = countCacheMisses(part.idx, part.vtx.size(), scratch);
+    if (missesAfter[i] > missesBefore[i])
+    {
+      part.idx.assign(original.begin(), original.end());
+      missesAfter[i] = missesBefore[i];
+    }
+
+    optimizeVertexFetch(part, scratch);
+  });
+
+  size_t numTriangles = 0;
+  size_t before = 0;
+  size_t after = 0;
+  for (size_t i = 0; i < parts.size(); i++)
+  {
+    numTriangles += parts[i].idx.size() / 3;
+    before += missesBefore[i];
+    after += missesAfter[i];
+  }
+
+  if (numTriangles > 0)
+  {
+    std::cout << std::format("MeshOptimizer::optimize> {}: {} triangles, ACMR {:.3f} -> {:.3f}\n",
+      name, numTriangles, (float)before / numTriangles, (float)after / numTriangles);
+  }
+}
@@ -0,0 +1,184 @@
+#include "meshtangents.h"
+#include "threadpool.h"
+#include "loadarena.h"
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+// Triangles or vertices per parallel work item.
+static const size_t TANGENT_BLOCK_SIZE = 4096;
+
+static inline glm::vec3 unitNormal(const MeshVertex& vtx)
+{
+  float len = glm::length(vtx.normal);
+  return len > 0.f ? vtx.normal / len : glm::vec3(0.f);
+}
+
+// Remove the component of `v` along the unit normal `n`.
+static inline glm::vec3 projectToPlane(const glm::vec3& n, const glm::vec3& v)
+{
+  return v - n * glm::dot(n, v);
+}
+
+static glm::vec4 finishTangent(const glm::vec3& n, const glm::vec3& sum, float sign)
+{
+  glm::vec3 t = projectToPlane(n, sum);
+  float len = glm::length(t);
+  if (len <= FLT_MIN)
+  {
+    // Nothing usable was accumulated, any direction in the normal plane will do.
+    glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+    t = projectToPlane(n, axis);
+    len = glm::length(t);
+  }
+
+  return glm::vec4(t / len, sign);
+}
+
+template <class Fn>
+static void parallelForBlocks(size_t count, Fn&& fn)
+{
+  size_t numBlocks = (count + TANGENT_BLOCK_SIZE - 1) / TANGENT_BLOCK_SIZE;
+  ThreadPool::global().parallelFor(numBlocks, [&](size_t iBlock) {
+    size_t begin = iBlock * TANGENT_BLOCK_SIZE;
+    size_t end = std::min(begin + TANGENT_BLOCK_SIZE, count);
+    for (size_t i = begin; i < end; i++)
+      fn(i);
+  });
+}
+
+void MeshTangents::generate(MeshPartData& part, ArenaCounter* counter)
+{
+#ifdef TANGENT_BASIS
+  const size_t numTriangles = part.idx.size() / 3;
+  const size_t numVertices = part.vtx.size();
+  if (numTriangles == 0)
+    return;
+
+  LoadArena arena(counter);
+  std::pmr::memory_resource* scratch = arena.resource();
+
+  // Per face uv winding, 0 when the uv mapping is degenerate. Per corner the face tangent
+  // projected into the vertex's normal plane and weighted by the corner angle.
+  std::pmr::vector<int8_t> orientation(numTriangles, 0, scratch);
+  std::pmr::vector<glm::vec3> contribution(part.idx.size(), glm::vec3(0.f), scratch);
+
+  parallelForBlocks(numTriangles, [&](size_t iTri) {
+    const MeshVertex* v[3] = {
+      &part.vtx[part.idx[3 * iTri + 0]],
+      &part.vtx[part.idx[3 * iTri + 1]],
+      &part.vtx[part.idx[3 * iTri + 2]] };
+
+    glm::vec3 d1 = v[1]->position - v[0]->position;
+    glm::vec3 d2 = v[2]->position - v[0]->position;
+    glm::vec2 t1 = v[1]->uv - v[0]->uv;
+    glm::vec2 t2 = v[2]->uv - v[0]->uv;
+
+    float signedArea = t1.x * t2.y - t1.y * t2.x;
+    if (std::abs(signedArea) <= FLT_MIN)
+      return;
+
+    // dP/du, flipped with the uv winding so it always points along +u.
+    glm::vec3 faceTangent = d1 * t2.y - d2 * t1.y;
+    float len = glm::length(faceTangent);
+    if (len <= FLT_MIN)
+      return;
+
+    float sign = signedArea > 0.f ? 1.f : -1.f;
+    faceTangent = faceTangent * (sign / len);
+    orientation[iTri] = signedArea > 0.f ? 1 : -1;
+
+    for (int corner = 0; corner < 3; corner++)
+    {
+      glm::vec3 n = unitNormal(*v[corner]);
+
+      glm::vec3 e0 = projectToPlane(n, v[(corner + 1) % 3]->position - v[corner]->position);
+      glm::vec3 e1 = projectToPlane(n, v[(corner + 2) % 3]->position - v[corner]->position);
+      float l0 = glm::length(e0);
+      float l1 = glm::length(e1);
+      if (l0 <= FLT_MIN || l1 <= FLT_MIN)
+        continue;
+
+      float angle = std::acos(std::clamp(glm::dot(e0, e1) / (l0 * l1), -1.f, 1.f));
+
+      glm::vec3 t = projectToPlane(n, faceTangent);
+      float lt = glm::length(t);
+      if (lt > FLT_MIN)
+        contribution[3 * iTri + corner] = t * (angle / lt);
+    }
+  });
+
+  // Vertex to corner adjacency, corners in index order.
+  std::pmr::vector<size_t> cornerOffset(numVertices + 1, 0, scratch);
+  for (unsigned int v : part.idx)
+    cornerOffset[v + 1]++;
+  for (size_t v = 0; v < numVertices; v++)
+    cornerOffset[v + 1] += cornerOffset[v];
+
+  std::pmr::vector<unsigned int> corners(part.idx.size(), scratch);
+  {
+    std::pmr::vector<size_t> fill(cornerOffset.begin(), cornerOffset.end() - 1, scratch);
+    for (size_t i = 0; i < part.idx.size(); i++)
+      corners[fill[part.idx[i]]++] = (unsigned int)i;
+  }
+
+  // A vertex keeps the winding of its first textured face. Faces with the other winding
+  // move to a split copy of the vertex.
+  std::pmr::vector<int8_t> primary(numVertices, 1, scratch);
+  std::pmr::vector<uint8_t> needsSplit(numVertices, 0, scratch);
+  parallelForBlocks(numVertices, [&](size_t v) {
+    int8_t first = 0;
+    for (size_t i = cornerOffset[v]; i < cornerOffset[v + 1]; i++)
+    {
+      int8_t o = orientation[corners[i] / 3];
+      if (o == 0)
+        continue;
+
+      if (first == 0)
+        first = o;
+      else if (o != first)
+        needsSplit[v] = 1;
+    }
+    primary[v] = first ? first : 1;
+  });
+
+  std::pmr::vector<unsigned int> splitVertex(numVertices, 0, scratch);
+  size_t numSplits = 0;
+  for (size_t v = 0; v < numVertices; v++)
+  {
+    if (needsSplit[v])
+      splitVertex[v] = (unsigned int)(numVertices + numSplits++);
+  }
+  part.vtx.resize(numVertices + numSplits);
+
+  parallelForBlocks(numVertices, [&](size_t v) {
+    glm::vec3 sumPrimary(0.f);
+    glm::vec3 sumSecondary(0.f);
+    for (size_t i = cornerOffset[v]; i < cornerOffset[v + 1]; i++)
+    {
+      unsigned int corner = corners[i];
+      int8_t o = orientation[corner / 3];
+      if (o == 0 || o == primary[v])
+      {
+        sumPrimary += contribution[corner];
+      }
+      else
+      {
+        sumSecondary += contribution[corner];
+        part.idx[corner] = splitVertex[v];
+      }
+    }
+
+    MeshVertex& vtx = part.vtx[v];
+    glm::vec3 n = unitNormal(vtx);
+    vtx.tangent = finishTangent(n, sumPrimary, (float)primary[v]);
+
+    if (needsSplit[v])
+    {
+      MeshVertex& split = part.vtx[splitVertex[v]];
+      split = vtx;
+      split.tangent = finishTangent(n, sumSecondary, (float)-primary[v]);
+    }
+  });
+#endif // TANGENT_BASIS
+}
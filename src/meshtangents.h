@@ -0,0 +1,20 @@
+#ifndef _MESHTANGENTS_H
+#define _MESHTANGENTS_H
+#include "mesh.h"
+
+class ArenaCounter;
+
+// MikkTSpace-style tangent generation. Every corner contributes its face's tangent,
+// projected into the vertex normal's plane and weighted by the corner angle, and the
+// sum is orthonormalized per vertex. Vertices whose faces disagree on the uv winding
+// are split so each copy carries one bitangent sign.
+//
+// Work runs in parallel over triangles and vertices. Each vertex sums its corners in
+// index order, so the result does not depend on the thread count.
+class MeshTangents
+{
+public:
+  static void generate(MeshPartData& part, ArenaCounter* counter = nullptr);
+};
+
+#endif // _MESHTANGENTS_H
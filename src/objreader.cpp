@@ -0,0 +1,635 @@
+#include "objreader.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+#include "vertexdedupetable.h"
+#include "loadarena.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <unordered_map>
+#include <charconv>
+#include <format>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OBJREADER_SSE2
+#include <emmintrin.h>
+#endif
+
+// Files smaller than this are parsed as a single chunk.
+static const size_t OBJ_MIN_CHUNK_SIZE = 256 * 1024;
+
+// Faces of one material within a chunk, in file order.
+struct ObjFaceBucket
+{
+  std::pmr::vector<uint32_t> faceSizes;
+  std::pmr::vector<MeshIndexKey> corners;
+
+  ObjFaceBucket(std::pmr::memory_resource* resource) : faceSizes(resource), corners(resource) { }
+};
+
+struct ObjChunk
+{
+  const char* begin;
+  const char* end;
+
+  // Owned by the chunk's thread while parsing.
+  std::unique_ptr<LoadArena> arena;
+
+  // Pass 1: attribute counts, then their global offsets.
+  size_t numPositions = 0;
+  size_t numNormals = 0;
+  size_t numUVs = 0;
+  size_t positionOffset = 0;
+  size_t normalOffset = 0;
+  size_t uvOffset = 0;
+  std::vector<std::string> mtllibs;
+
+  // Pass 2: faces bucketed by material + 2. Bucket 0 holds faces before the chunk's
+  // first usemtl, whose material is only known once the previous chunks are parsed.
+  std::pmr::vector<ObjFaceBucket> buckets;
+  bool bSetsMaterial = false;
+  int lastMaterial = -1;
+  int inheritedMaterial = -1;
+
+  ObjChunk(const char* begin, const char* end, ArenaCounter* counter)
+    : begin(begin)
+    , end(end)
+    , arena(std::make_unique<LoadArena>(counter))
+    , buckets(arena->resource())
+  {
+  }
+};
+
+// Find the next '\n' in [p, end), or end.
+static inline const char* findNewline(const char* p, const char* end)
+{
+#ifdef OBJREADER_SSE2
+  const __m128i newline = _mm_set1_epi8('\n');
+  while (end - p >= 16)
+  {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline));
+    if (mask)
+      return p + std::countr_zero(mask);
+    p += 16;
+  }
+#endif // OBJREADER_SSE2
+
+  while (p < end && *p != '\n')
+    p++;
+  return p;
+}
+
+static inline bool isSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Find the next whitespace character in [p, end), or end.
+static inline const char* findSpace(const char* p, const char* end)
+{
+#ifdef OBJREADER_SSE2
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  while (end - p >= 16)
+  {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+    __m128i match = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab)),
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, cr), _mm_cmpeq_epi8(bytes, lf)));
+    unsigned mask = (unsigned)_mm_movemask_epi8(match);
+    if (mask)
+      return p + std::countr_zero(mask);
+    p += 16;
+  }
+#endif // OBJREADER_SSE2
+
+  while (p < end && !isSpace(*p))
+    p++;
+  return p;
+}
+
+static inline const char* skipSpace(const char* p, const char* end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  return p;
+}
+
+static inline bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static const float s_pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+// Parse a float. Plain decimals with at most 7 significant digits and 10 fraction digits
+// have an exactly representable mantissa and power of ten, so one correctly rounded
+// division gives the exact result. Everything else goes through std::from_chars.
+static inline bool parseFloat(const char*& p, const char* end, float& out)
+{
+  const char* start = p;
+
+  bool bNegative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+  {
+    bNegative = *p == '-';
+    p++;
+  }
+
+  uint32_t mantissa = 0;
+  int numSignificant = 0;
+  int numFraction = 0;
+  bool bAnyDigit = false;
+
+  while (p < end && isDigit(*p))
+  {
+    uint32_t digit = *p - '0';
+    if (mantissa || digit)
+    {
+      if (numSignificant < 9)
+        mantissa = mantissa * 10 + digit;
+      numSignificant++;
+    }
+    bAnyDigit = true;
+    p++;
+  }
+
+  if (p < end && *p == '.')
+  {
+    p++;
+    while (p < end && isDigit(*p))
+    {
+      uint32_t digit = *p - '0';
+      if (mantissa || digit)
+      {
+        if (numSignificant < 9)
+          mantissa = mantissa * 10 + digit;
+        numSignificant++;
+      }
+      numFraction++;
+      bAnyDigit = true;
+      p++;
+    }
+  }
+
+  if (!bAnyDigit)
+  {
+    p = start;
+    return false;
+  }
+
+  bool bExponent = p < end && (*p == 'e' || *p == 'E');
+  if (bExponent || numSignificant > 7 || numFraction > 10)
+  {
+    // from_chars does not accept a leading '+'.
+    const char* first = (*start == '+') ? start + 1 : start;
+    auto result = std::from_chars(first, end, out);
+    if (result.ec != std::errc())
+    {
+      p = start;
+      return false;
+    }
+    p = result.ptr;
+    return true;
+  }
+
+  out = (float)mantissa / s_pow10[numFraction];
+  if (bNegative)
+    out = -out;
+  return true;
+}
+
+static inline bool parseInt(const char*& p, const char* end, int& out)
+{
+  bool bNegative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+  {
+    bNegative = *p == '-';
+    p++;
+  }
+
+  if (p >= end || !isDigit(*p))
+    return false;
+
+  int value = 0;
+  while (p < end && isDigit(*p))
+  {
+    value = value * 10 + (*p - '0');
+    p++;
+  }
+
+  out = bNegative ? -value : value;
+  return true;
+}
+
+// OBJ indices are 1-based, negative ones count back from the last attribute defined.
+// Returns -1 when the index is missing.
+static inline int resolveIndex(int idx, size_t countSoFar)
+{
+  if (idx > 0)
+    return idx - 1;
+  if (idx < 0)
+    return (int)countSoFar + idx;
+  return -1;
+}
+
+static inline bool matchKeyword(const char* p, const char* end, const char* keyword, size_t len)
+{
+  return (size_t)(end - p) > len && memcmp(p, keyword, len) == 0 && (p[len] == ' ' || p[len] == '\t');
+}
+
+static std::string readName(const char* p, const char* end)
+{
+  p = skipSpace(p, end);
+  while (end > p && isSpace(end[-1]))
+    end--;
+  return std::string(p, end);
+}
+
+// Iterate the lines of [begin, end), handing each one to fn without the line break.
+template <class Fn>
+static inline void forEachLine(const char* begin, const char* end, Fn&& fn)
+{
+  const char* p = begin;
+  while (p < end)
+  {
+    const char* lineEnd = findNewline(p, end);
+    const char* contentEnd = lineEnd;
+    if (contentEnd > p && contentEnd[-1] == '\r')
+      contentEnd--;
+
+    const char* line = skipSpace(p, contentEnd);
+    if (line < contentEnd)
+      fn(line, contentEnd);
+
+    p = lineEnd + 1;
+  }
+}
+
+static void countChunk(ObjChunk& chunk)
+{
+  forEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end) {
+    if (p[0] == 'v')
+    {
+      if (matchKeyword(p, end, "v", 1))
+        chunk.numPositions++;
+      else if (matchKeyword(p, end, "vn", 2))
+        chunk.numNormals++;
+      else if (matchKeyword(p, end, "vt", 2))
+        chunk.numUVs++;
+    }
+    else if (p[0] == 'm' && matchKeyword(p, end, "mtllib", 6))
+    {
+      chunk.mtllibs.push_back(readName(p + 6, end));
+    }
+  });
+}
+
+static void parseChunk(ObjChunk& chunk, const std::unordered_map<std::string, int>& materialIds, size_t numMaterials,
+  float* positions, float* normals, float* uvs)
+{
+  size_t iPosition = chunk.positionOffset;
+  size_t iNormal = chunk.normalOffset;
+  size_t iUV = chunk.uvOffset;
+
+  chunk.buckets.reserve(numMaterials + 2);
+  for (size_t i = 0; i < numMaterials + 2; i++)
+    chunk.buckets.emplace_back(chunk.arena->resource());
+  ObjFaceBucket* bucket = &chunk.buckets[0];
+
+  forEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end) {
+    if (p[0] == 'v')
+    {
+      if (matchKeyword(p, end, "v", 1))
+      {
+        p += 1;
+        float* out = &positions[3 * iPosition++];
+        for (int i = 0; i < 3; i++)
+        {
+          p = skipSpace(p, end);
+          if (!parseFloat(p, end, out[i]))
+            out[i] = 0.f;
+        }
+      }
+      else if (matchKeyword(p, end, "vn", 2))
+      {
+        p += 2;
+        float* out = &normals[3 * iNormal++];
+        for (int i = 0; i < 3; i++)
+        {
+          p = skipSpace(p, end);
+          if (!parseFloat(p, end, out[i]))
+            out[i] = 0.f;
+        }
+      }
+      else if (matchKeyword(p, end, "vt", 2))
+      {
+        p += 2;
+        float* out = &uvs[2 * iUV++];
+        for (int i = 0; i < 2; i++)
+        {
+          p = skipSpace(p, end);
+          if (!parseFloat(p, end, out[i]))
+            out[i] = 0.f;
+        }
+      }
+    }
+    else if (p[0] == 'f' && matchKeyword(p, end, "f", 1))
+    {
+      p += 1;
+      uint32_t numCorners = 0;
+      for (;;)
+      {
+        p = skipSpace(p, end);
+        if (p >= end)
+          break;
+
+        int v = 0, vt = 0, vn = 0;
+        if (!parseInt(p, end, v))
+          break;
+        if (p < end && *p == '/')
+        {
+          p++;
+          if (p < end && *p != '/')
+            parseInt(p, end, vt);
+          if (p < end && *p == '/')
+          {
+            p++;
+            parseInt(p, end, vn);
+          }
+        }
+        p = findSpace(p, end);
+
+        bucket->corners.push_back({ resolveIndex(v, iPosition), resolveIndex(vn, iNormal), resolveIndex(vt, iUV) });
+        numCorners++;
+      }
+      bucket->faceSizes.push_back(numCorners);
+    }
+    else if (p[0] == 'u' && matchKeyword(p, end, "usemtl", 6))
+    {
+      auto found = materialIds.find(readName(p + 6, end));
+      int materialId = (found != materialIds.end()) ? found->second : -1;
+
+      chunk.bSetsMaterial = true;
+      chunk.lastMaterial = materialId;
+      bucket = &chunk.buckets[materialId + 2];
+    }
+  });
+}
+
+static void loadMaterials(const std::string& mtlPath, const std::string& materialsPath,
+  std::unordered_map<std::string, int>& materialIds, std::vector<std::string>& diffuseTextures)
+{
+  MappedFile file;
+  if (!file.open(mtlPath))
+  {
+    std::cerr << "ObjReader: Failed to open material library '" << mtlPath << "'\n";
+    return;
+  }
+
+  const char* begin = (const char*)file.data();
+  int current = -1;
+  forEachLine(begin, begin + file.size(), [&](const char* p, const char* end) {
+    if (matchKeyword(p, end, "newmtl", 6))
+    {
+      std::string name = readName(p + 6, end);
+      auto found = materialIds.find(name);
+      if (found != materialIds.end())
+      {
+        current = found->second;
+      }
+      else
+      {
+        current = (int)diffuseTextures.size();
+        materialIds[name] = current;
+        diffuseTextures.emplace_back();
+      }
+    }
+    else if (current >= 0 && matchKeyword(p, end, "map_Kd", 6))
+    {
+      // The texture name is the last token; anything before it is an option.
+      std::string args = readName(p + 6, end);
+      size_t split = args.find_last_of(" \t");
+      std::string texname = (split == std::string::npos) ? args : args.substr(split + 1);
+      diffuseTextures[current] = std::format("{}/{}", materialsPath, texname);
+    }
+  });
+}
+
+bool ObjReader::load(const std::string& file, std::vector<MeshPartData>& parts, bool ignoreMaterials, ArenaCounter* counter)
+{
+  MappedFile mapped;
+  if (!mapped.open(file))
+  {
+    std::cerr << "ObjReader: Failed to open '" << file << "'\n";
+    return false;
+  }
+
+  ThreadPool& pool = ThreadPool::global();
+
+  // Every temporary below lives in arenas that go away with this function.
+  LoadArena arena(counter);
+  if (!counter)
+    counter = &arena.counter();
+
+  // Split the file into chunks at line boundaries.
+  const char* fileBegin = (const char*)mapped.data();
+  const char* fileEnd = fileBegin + mapped.size();
+
+  size_t numChunks = std::max<size_t>(1, std::min<size_t>(pool.numThreads() * 4, mapped.size() / OBJ_MIN_CHUNK_SIZE));
+  std::pmr::vector<ObjChunk> chunks(arena.resource());
+  chunks.reserve(numChunks);
+
+  const char* chunkBegin = fileBegin;
+  for (size_t i = 0; i < numChunks && chunkBegin < fileEnd; i++)
+  {
+    const char* chunkEnd = (i + 1 == numChunks) ? fileEnd : fileBegin + mapped.size() * (i + 1) / numChunks;
+    if (chunkEnd < chunkBegin)
+      chunkEnd = chunkBegin;
+    chunkEnd = findNewline(chunkEnd, fileEnd);
+    if (chunkEnd < fileEnd)
+      chunkEnd++;
+
+    chunks.emplace_back(chunkBegin, chunkEnd, counter);
+
+    chunkBegin = chunkEnd;
+  }
+
+  // Pass 1: count attributes so each chunk knows where its attributes land globally.
+  pool.parallelFor(chunks.size(), [&](size_t i) { countChunk(chunks[i]); });
+
+  size_t numPositions = 0;
+  size_t numNormals = 0;
+  size_t numUVs = 0;
+  for (ObjChunk& chunk : chunks)
+  {
+    chunk.positionOffset = numPositions;
+    chunk.normalOffset = numNormals;
+    chunk.uvOffset = numUVs;
+    numPositions += chunk.numPositions;
+    numNormals += chunk.numNormals;
+    numUVs += chunk.numUVs;
+  }
+
+  // Materials are needed to bucket faces, so load them between the passes.
+  std::string materialsPath = std::filesystem::path(file).parent_path().string();
+  std::unordered_map<std::string, int> materialIds;
+  std::vector<std::string> diffuseTextures;
+  for (const ObjChunk& chunk : chunks)
+  {
+    for (const std::string& mtllib : chunk.mtllibs)
+      loadMaterials((std::filesystem::path(materialsPath) / mtllib).string(), materialsPath, materialIds, diffuseTextures);
+  }
+
+  // Pass 2: parse attributes into the shared arrays and bucket faces.
+  std::pmr::vector<float> positions(3 * numPositions, arena.resource());
+  std::pmr::vector<float> normals(3 * numNormals, arena.resource());
+  std::pmr::vector<float> uvs(2 * numUVs, arena.resource());
+
+  pool.parallelFor(chunks.size(), [&](size_t i) {
+    parseChunk(chunks[i], materialIds, diffuseTextures.size(), positions.data(), normals.data(), uvs.data());
+  });
+
+  // Resolve the material active at the start of each chunk.
+  int material = -1;
+  for (ObjChunk& chunk : chunks)
+  {
+    chunk.inheritedMaterial = material;
+    if (chunk.bSetsMaterial)
+      material = chunk.lastMaterial;
+  }
+
+  // Pass 3: triangulate and dedupe each part.
+  if (ignoreMaterials)
+  {
+    parts.resize(1, MeshPartData());
+  }
+  else
+  {
+    parts.resize(1 + diffuseTextures.size(), MeshPartData());
+    for (size_t i = 0; i < diffuseTextures.size(); i++)
+      parts[i + 1].diffuseTex = diffuseTextures[i];
+  }
+
+  std::pmr::vector<size_t> numInvalidFaces(parts.size(), 0, arena.resource());
+  pool.parallelFor(parts.size(), [&](size_t iPart) {
+    MeshPartData& part = parts[iPart];
+    int partMaterial = (int)iPart - 1;
+
+    LoadArena partArena(counter);
+
+    // Gather this part's buckets in file order.
+    std::pmr::vector<const ObjFaceBucket*> buckets(partArena.resource());
+    size_t numCorners = 0;
+    for (const ObjChunk& chunk : chunks)
+    {
+      for (size_t iBucket = 0; iBucket < chunk.buckets.size(); iBucket++)
+      {
+        int bucketMaterial = (iBucket == 0) ? chunk.inheritedMaterial : (int)iBucket - 2;
+        if (!ignoreMaterials && bucketMaterial != partMaterial)
+          continue;
+        if (chunk.buckets[iBucket].faceSizes.empty())
+          continue;
+
+        buckets.push_back(&chunk.buckets[iBucket]);
+        numCorners += chunk.buckets[iBucket].corners.size();
+      }
+    }
+
+    if (numCorners == 0)
+      return;
+
+    VertexDedupeTable dedupe(partArena.resource());
+    dedupe.reserve(numCorners);
+    part.idx.reserve(numCorners);
+
+    auto emitVertex = [&](const MeshIndexKey& key) {
+      unsigned int iVertex = (unsigned int)dedupe.findOrInsert(key, (int)part.vtx.size());
+      if (iVertex == part.vtx.size())
+      {
+        MeshVertex vertex = {};
+        vertex.position = glm::vec3(positions[3 * key.posIdx + 0], positions[3 * key.posIdx + 1], positions[3 * key.posIdx + 2]);
+
+        if (key.normalIdx >= 0)
+          vertex.normal = glm::vec3(normals[3 * key.normalIdx + 0], normals[3 * key.normalIdx + 1], normals[3 * key.normalIdx + 2]);
+
+        // flip uv
+        if (key.uvIdx >= 0)
+          vertex.uv = glm::vec2(uvs[2 * key.uvIdx + 0], 1.0f - uvs[2 * key.uvIdx + 1]);
+
+        part.vtx.push_back(vertex);
+      }
+      part.idx.push_back(iVertex);
+    };
+
+    auto position = [&](const MeshIndexKey& key) {
+      return glm::vec3(positions[3 * key.posIdx + 0], positions[3 * key.posIdx + 1], positions[3 * key.posIdx + 2]);
+    };
+
+    for (const ObjFaceBucket* bucket : buckets)
+    {
+      const MeshIndexKey* corners = bucket->corners.data();
+      for (uint32_t faceSize : bucket->faceSizes)
+      {
+        const MeshIndexKey* face = corners;
+        corners += faceSize;
+
+        bool bValid = faceSize >= 3;
+        for (uint32_t i = 0; i < faceSize && bValid; i++)
+        {
+          bValid = face[i].posIdx >= 0 && (size_t)face[i].posIdx < numPositions
+            && face[i].normalIdx < (int)numNormals
+            && face[i].uvIdx < (int)numUVs;
+        }
+
+        if (!bValid)
+        {
+          numInvalidFaces[iPart]++;
+          continue;
+        }
+
+        if (faceSize == 4)
+        {
+          // Split quads along the shorter diagonal, matching tinyobj.
+          glm::vec3 e02 = position(face[2]) - position(face[0]);
+          glm::vec3 e13 = position(face[3]) - position(face[1]);
+          if (glm::dot(e02, e02) < glm::dot(e13, e13))
+          {
+            emitVertex(face[0]); emitVertex(face[1]); emitVertex(face[2]);
+            emitVertex(face[0]); emitVertex(face[2]); emitVertex(face[3]);
+          }
+          else
+          {
+            emitVertex(face[0]); emitVertex(face[1]); emitVertex(face[3]);
+            emitVertex(face[1]); emitVertex(face[2]); emitVertex(face[3]);
+          }
+          continue;
+        }
+
+        // Triangles and convex polygons as a fan.
+        for (uint32_t i = 1; i + 1 < faceSize; i++)
+        {
+          emitVertex(face[0]);
+          emitVertex(face[i]);
+          emitVertex(face[i + 1]);
+        }
+      }
+    }
+  });
+
+  size_t totalInvalid = 0;
+  for (size_t count : numInvalidFaces)
+    totalInvalid += count;
+  if (totalInvalid > 0)
+    std::cerr << "ObjReader: Skipped " << totalInvalid << " faces with invalid indices in '" << file << "'\n";
+
+  return true;
+}
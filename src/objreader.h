@@ -0,0 +1,24 @@
+#ifndef _OBJREADER_H
+#define _OBJREADER_H
+#include <string>
+#include <vector>
+#include "mesh.h"
+
+class ArenaCounter;
+
+// Memory-mapped Wavefront OBJ reader that builds deduplicated MeshPartData directly.
+//
+// The file is split into chunks at line boundaries which are parsed on the thread pool:
+// a first pass counts attributes per chunk so every chunk knows its global index offsets,
+// a second pass parses attributes straight into the shared position/normal/uv arrays and
+// buckets faces by material, and a final pass triangulates and dedupes each part.
+class ObjReader
+{
+public:
+  // Parse `file` into parts. Part 0 takes faces without a material, part i + 1 takes
+  // material i. With `ignoreMaterials` every face goes into a single part. Scratch memory
+  // is reported to `counter` when given.
+  static bool load(const std::string& file, std::vector<MeshPartData>& parts, bool ignoreMaterials = false, ArenaCounter* counter = nullptr);
+};
+
+#endif // _OBJREADER_H
@@ -2,12 +2,94 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <filesystem>
+#include <cstring>
+#include <format>
+#include <unordered_map>
+#include <glm/gtc/type_ptr.hpp>
+
+#ifndef SHADER_CACHE_DIR
+#define SHADER_CACHE_DIR "cache"
+#endif // SHADER_CACHE_DIR
+
+static const uint32_t SHADER_CACHE_MAGIC = 0x43444853; // 'SHDC'
+static const uint32_t SHADER_CACHE_VERSION = 1;
+
+struct ProgramBinaryHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  uint32_t binaryFormat;
+  uint32_t size;
+};
 
 static char shaderLog[512];
 
+static uint64_t fnv1a(const void* data, size_t len, uint64_t hash = 0xcbf29ce484222325ull)
+{
+  const unsigned char* bytes = (const unsigned char*)data;
+  for (size_t i = 0; i < len; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// Binaries are only valid for the driver that produced them.
+static uint64_t driverHash()
+{
+  static uint64_t hash = 0;
+  if (hash)
+    return hash;
+
+  hash = fnv1a(&SHADER_CACHE_VERSION, sizeof(SHADER_CACHE_VERSION));
+  for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+  {
+    const char* str = (const char*)glGetString(name);
+    if (str)
+      hash = fnv1a(str, strlen(str), hash);
+  }
+  return hash;
+}
+
+static bool supportsProgramBinaries()
+{
+  static int numFormats = -1;
+  if (numFormats < 0)
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+  return numFormats > 0;
+}
+
+static std::string binaryPath(uint64_t hash)
+{
+  return (std::filesystem::path(SHADER_CACHE_DIR) / std::format("program_{:016x}.bin", hash)).string();
+}
+
+// Names live for the whole run, ids are indices into this table.
+static std::unordered_map<std::string, uint32_t>& uniformNames()
+{
+  static std::unordered_map<std::string, uint32_t> names;
+  return names;
+}
+
+static uint32_t internUniform(const std::string& name)
+{
+  std::unordered_map<std::string, uint32_t>& names = uniformNames();
+  auto [it, bInserted] = names.try_emplace(name, (uint32_t)names.size());
+  return it->second;
+}
+
+UniformId::UniformId(const char* name)
+  : index(internUniform(name))
+{
+}
+
 Shader::Shader(GLuint type, const std::string& path, const DefinesList& defines)
   : id(0)
   , type(type)
+  , path(path)
 {
   loadFromFile(type, path, defines);
 }
@@ -19,8 +101,6 @@ Shader::~Shader()
 
 void Shader::loadFromFile(GLuint type, const std::string& path, const DefinesList& defines)
 {
-  id = glCreateShader(type);
-
   std::ifstream t(path);
   std::stringstream buffer;
 
@@ -31,34 +111,72 @@ void Shader::loadFromFile(GLuint type, const std::string& path, const DefinesLis
 
   buffer << t.rdbuf();
 
-  std::string sourceStr = buffer.str();
-  const char* pSourceStr = sourceStr.c_str();
-  //std::cout << "Compile from source: " << sourceStr << "\n";
+  source = buffer.str();
+}
+
+void Shader::compile()
+{
+  if (id)
+    return;
+
+  id = glCreateShader(type);
+
+  const char* pSourceStr = source.c_str();
+  //std::cout << "Compile from source: " << source << "\n";
 
   glShaderSource(id, 1, &pSourceStr, NULL);
   glCompileShader(id);
 
-  // check for errors
-  int success;
-  glGetShaderiv(id, GL_COMPILE_STATUS, &success);
-  if (!success)
+  std::cout << "Compiling shader: " << path << "\n";
+}
+
+typedef void (*PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+bool ShaderProgram::s_bParallelCompile = false;
+
+void ShaderProgram::initParallelCompile(GLADloadproc load)
+{
+  GLint numExtensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+  for (GLint i = 0; i < numExtensions; i++)
+  {
+    const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+    if (name && (strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || strcmp(name, "GL_ARB_parallel_shader_compile") == 0))
+    {
+      s_bParallelCompile = true;
+      break;
+    }
+  }
+
+  if (!s_bParallelCompile)
   {
-    glGetShaderInfoLog(id, sizeof(shaderLog), NULL, shaderLog);
-    std::cout << "Shader::loadFromFile> Shader compile:\n" << shaderLog << "\n";
+    std::cout << "ShaderProgram::initParallelCompile> No parallel shader compile, programs link synchronously.\n";
+    return;
   }
 
-  std::cout << "Compiled shader: " << path << "\n";
+  // Let the driver pick its thread count, some default to compiling on the calling thread.
+  auto maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+  if (!maxThreads)
+    maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+  if (maxThreads)
+    maxThreads(0xFFFFFFFF);
 }
 
 ShaderProgram::ShaderProgram()
   : prog(0)
+  , hash(0)
+  , bLinking(false)
 {
 }
 
-ShaderProgram::ShaderProgram(const std::vector<Shader*>& link)
+ShaderProgram::ShaderProgram(const std::vector<Shader*>& link, bool bAsync)
   : prog(0)
+  , hash(0)
+  , bLinking(false)
 {
   create(link);
+  if (!bAsync)
+    wait();
 }
 
 ShaderProgram::~ShaderProgram()
@@ -78,22 +196,256 @@ void ShaderProgram::bind(void) const
   glUseProgram(prog);
 }
 
+bool ShaderProgram::isReady()
+{
+  if (!bLinking)
+    return true;
+
+  if (s_bParallelCompile)
+  {
+    GLint bComplete = GL_FALSE;
+    glGetProgramiv(prog, GL_COMPLETION_STATUS_KHR, &bComplete);
+    if (!bComplete)
+      return false;
+  }
+
+  finishLink();
+  return true;
+}
+
+void ShaderProgram::wait()
+{
+  if (bLinking)
+    finishLink();
+}
+
+void ShaderProgram::reflect()
+{
+  uniforms.clear();
+  blockBindings.clear();
+
+  char name[256];
+
+  GLint numUniforms = 0;
+  glGetProgramInterfaceiv(prog, GL_UNIFORM, GL_ACTIVE_RESOURCES, &numUniforms);
+  for (GLint i = 0; i < numUniforms; i++)
+  {
+    // Block members have no location and are set through their buffer.
+    const GLenum prop = GL_LOCATION;
+    GLint location;
+    glGetProgramResourceiv(prog, GL_UNIFORM, i, 1, &prop, 1, nullptr, &location);
+    if (location < 0)
+      continue;
+
+    glGetProgramResourceName(prog, GL_UNIFORM, i, sizeof(name), nullptr, name);
+
+    // Arrays are reported as "name[0]", look them up by their plain name.
+    std::string uniformName = name;
+    if (uniformName.ends_with("[0]"))
+      uniformName.resize(uniformName.size() - 3);
+
+    uint32_t index = internUniform(uniformName);
+    if (index >= uniforms.size())
+      uniforms.resize(index + 1, { -1, false, {} });
+    uniforms[index] = { location, false, {} };
+  }
+
+  for (GLenum blockInterface : { GL_UNIFORM_BLOCK, GL_SHADER_STORAGE_BLOCK })
+  {
+    GLint numBlocks = 0;
+    glGetProgramInterfaceiv(prog, blockInterface, GL_ACTIVE_RESOURCES, &numBlocks);
+    for (GLint i = 0; i < numBlocks; i++)
+    {
+      const GLenum prop = GL_BUFFER_BINDING;
+      GLint binding;
+      glGetProgramResourceiv(prog, blockInterface, i, 1, &prop, 1, nullptr, &binding);
+      glGetProgramResourceName(prog, blockInterface, i, sizeof(name), nullptr, name);
+
+      uint32_t index = internUniform(name);
+      if (index >= blockBindings.size())
+        blockBindings.resize(index + 1, -1);
+      blockBindings[index] = binding;
+    }
+  }
+}
+
+ShaderProgram::UniformSlot* ShaderProgram::changedSlot(UniformId id, const void* value, size_t size) const
+{
+  if (!hasUniform(id))
+    return nullptr;
+
+  UniformSlot& slot = uniforms[id.index];
+  if (slot.bSet && memcmp(slot.value, value, size) == 0)
+    return nullptr;
+
+  memcpy(slot.value, value, size);
+  slot.bSet = true;
+  return &slot;
+}
+
+void ShaderProgram::setUniform(UniformId id, int value) const
+{
+  if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+    glProgramUniform1i(prog, slot->location, value);
+}
+
+void ShaderProgram::setUniform(UniformId id, float value) const
+{
+  if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+    glProgramUniform1f(prog, slot->location, value);
+}
+
+void ShaderProgram::setUniform(UniformId id, const glm::vec3& value) const
+{
+  if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+    glProgramUniform3fv(prog, slot->location, 1, glm::value_ptr(value));
+}
+
+void ShaderProgram::setUniform(UniformId id, const glm::mat4& value) const
+{
+  if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+    glProgramUniformMatrix4fv(prog, slot->location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
 void ShaderProgram::create(const std::vector<Shader*>& link)
 {
+  hash = driverHash();
+  for (const Shader* shader : link)
+  {
+    hash = fnv1a(&shader->type, sizeof(shader->type), hash);
+    hash = fnv1a(shader->source.data(), shader->source.size(), hash);
+  }
+
+  if (supportsProgramBinaries() && loadBinary(hash))
+    return;
+
   prog = glCreateProgram();
+  glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
-  for (const Shader* shader : link)
+  // The shaders stay alive while attached, even once their Shader is destroyed.
+  for (Shader* shader : link)
+  {
+    shader->compile();
     glAttachShader(prog, shader->id);
+  }
 
   glLinkProgram(prog);
+  bLinking = true;
+}
+
+void ShaderProgram::finishLink()
+{
+  bLinking = false;
 
   // check for errors
   int success;
   glGetProgramiv(prog, GL_LINK_STATUS, &success);
   if (!success) {
+    GLuint shaders[8];
+    GLsizei numShaders = 0;
+    glGetAttachedShaders(prog, 8, &numShaders, shaders);
+    for (GLsizei i = 0; i < numShaders; i++)
+    {
+      int compiled;
+      glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+      if (!compiled)
+      {
+        glGetShaderInfoLog(shaders[i], sizeof(shaderLog), NULL, shaderLog);
+        std::cout << "ShaderProgram::finishLink> Shader compile:\n" << shaderLog << "\n";
+      }
+    }
+
     glGetProgramInfoLog(prog, sizeof(shaderLog), NULL, shaderLog);
-    std::cout << "ShaderProgram::create> Link error:\n" << shaderLog << "\n";
+    std::cout << "ShaderProgram::finishLink> Link error:\n" << shaderLog << "\n";
+  }
+  else
+  {
+    reflect();
+    if (supportsProgramBinaries())
+      saveBinary(hash);
   }
   
   std::cout << "Linked program " << prog << ".\n";
+}
+
+bool ShaderProgram::loadBinary(uint64_t hash)
+{
+  std::ifstream ifs(binaryPath(hash), std::ios::binary);
+  if (!ifs)
+    return false;
+
+  ProgramBinaryHeader header;
+  if (!ifs.read((char*)&header, sizeof(header))
+    || header.magic != SHADER_CACHE_MAGIC
+    || header.version != SHADER_CACHE_VERSION
+    || header.hash != hash)
+  {
+    return false;
+  }
+
+  std::vector<char> binary(header.size);
+  if (!ifs.read(binary.data(), binary.size()))
+    return false;
+
+  prog = glCreateProgram();
+  glProgramBinary(prog, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+
+  // Drivers reject binaries after an update even when the version string stays the same.
+  int success;
+  glGetProgramiv(prog, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    std::cout << "ShaderProgram::loadBinary> Driver rejected cached binary, recompiling.\n";
+    glDeleteProgram(prog);
+    prog = 0;
+    return false;
+  }
+
+  reflect();
+
+  std::cout << "Loaded program " << prog << " from cache.\n";
+  return true;
+}
+
+void ShaderProgram::saveBinary(uint64_t hash) const
+{
+  GLint size = 0;
+  glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0)
+    return;
+
+  ProgramBinaryHeader header = {};
+  header.magic = SHADER_CACHE_MAGIC;
+  header.version = SHADER_CACHE_VERSION;
+  header.hash = hash;
+
+  std::vector<char> binary(size);
+  GLenum binaryFormat = 0;
+  glGetProgramBinary(prog, size, nullptr, &binaryFormat, binary.data());
+  header.binaryFormat = binaryFormat;
+  header.size = (uint32_t)size;
+
+  std::error_code ec;
+  std::filesystem::create_directories(SHADER_CACHE_DIR, ec);
+
+  // Write to a temporary file first so a crash never leaves a half-written binary behind.
+  std::string path = binaryPath(hash);
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+    ofs.write((const char*)&header, sizeof(header));
+    ofs.write(binary.data(), binary.size());
+    if (!ofs)
+    {
+      std::cerr << "ShaderProgram::saveBinary> Failed to write " << tmpPath << "\n";
+      return;
+    }
+  }
+
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+  {
+    std::cerr << "ShaderProgram::saveBinary> Failed to move binary into place: " << ec.message() << "\n";
+    std::filesystem::remove(tmpPath, ec);
+  }
 }
\ No newline at end of file
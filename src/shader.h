@@ -3,7 +3,19 @@
 #include <glad/glad.h>
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
 
+// GL_KHR_parallel_shader_compile, glad is generated without extensions.
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif // GL_MAX_SHADER_COMPILER_THREADS_KHR
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif // GL_COMPLETION_STATUS_KHR
+
+// Holds the preprocessed source; the GL shader is only compiled when a program that uses
+// it misses the program binary cache.
 struct Shader
 {
 public:
@@ -11,6 +23,8 @@ public:
 
   GLuint id;
   GLuint type;
+  std::string path;
+  std::string source;
 
   Shader(GLuint type, const std::string& path, const DefinesList& defines = DefinesList());
   ~Shader();
@@ -19,21 +33,63 @@ public:
   Shader(const Shader&) = delete;
   Shader& operator=(const Shader&) = delete;
 
+  // Only issues the compile, errors are reported when the program links.
+  void compile();
+
 protected:
   void loadFromFile(GLuint type, const std::string& path, const DefinesList& defines);
 };
 
 
+// A uniform or block name interned once, so per-frame lookups index an array instead of
+// hashing a string. Declare them at file scope and reuse them across programs.
+struct UniformId
+{
+  uint32_t index;
+
+  explicit UniformId(const char* name);
+};
+
+// Linked programs are cached on disk with glGetProgramBinary, keyed by a hash of the
+// shader sources, their stages and the driver. A binary the driver rejects is recompiled
+// from source and written again.
+//
+// An async program returns from the constructor with the link still running on the
+// driver's compiler threads; isReady() polls it without blocking when the driver has
+// GL_KHR_parallel_shader_compile, and finishes it synchronously otherwise.
+//
+// Active uniforms and blocks are reflected once the link finishes. Uniform setters go
+// through glProgramUniform, so the program need not be bound, and skip values the program
+// already holds.
 struct ShaderProgram
 {
 protected:
+  struct UniformSlot
+  {
+    GLint location;
+    bool bSet;
+    alignas(16) uint8_t value[64];
+  };
+
   GLuint prog;
+  uint64_t hash;
+  bool bLinking;
+
+  // Indexed by UniformId, location -1 and binding -1 where the program has no such name.
+  mutable std::vector<UniformSlot> uniforms;
+  std::vector<GLint> blockBindings;
+
+  static bool s_bParallelCompile;
 
 public:
   ShaderProgram();
-  ShaderProgram(const std::vector<Shader*>& link);
+  ShaderProgram(const std::vector<Shader*>& link, bool bAsync = false);
   ~ShaderProgram();
 
+  // Call once after the context is current, with the same loader glad used.
+  static void initParallelCompile(GLADloadproc load);
+  static inline bool hasParallelCompile() { return s_bParallelCompile; }
+
   // delete copy constructor
   ShaderProgram(const ShaderProgram&) = delete;
   ShaderProgram& operator=(const ShaderProgram&) = delete;
@@ -41,8 +97,29 @@ public:
   int getUniformLocation(const char* uniform) const;
   void bind(void) const;
 
+  inline bool hasUniform(UniformId id) const { return id.index < uniforms.size() && uniforms[id.index].location >= 0; }
+  // Binding point of a uniform or shader storage block, -1 if the program has none.
+  inline GLint getBlockBinding(UniformId id) const { return id.index < blockBindings.size() ? blockBindings[id.index] : -1; }
+
+  void setUniform(UniformId id, int value) const;
+  void setUniform(UniformId id, float value) const;
+  void setUniform(UniformId id, const glm::vec3& value) const;
+  void setUniform(UniformId id, const glm::mat4& value) const;
+
+  bool isReady();
+  // Blocks until the link has finished.
+  void wait();
+
 protected:
   void create(const std::vector<Shader*>& link);
+  void finishLink();
+  void reflect();
+
+  // The slot to upload to, or null when the uniform is missing or already holds `value`.
+  UniformSlot* changedSlot(UniformId id, const void* value, size_t size) const;
+
+  bool loadBinary(uint64_t hash);
+  void saveBinary(uint64_t hash) const;
 };
 
 #endif // _SHADER_H
\ No newline at end of file
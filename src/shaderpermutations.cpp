@@ -0,0 +1,102 @@
+#include "shaderpermutations.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+ShaderPermutations::ShaderPermutations(std::initializer_list<int> axes, Builder builder)
+  : m_axes(axes)
+  , m_builder(std::move(builder))
+  , m_numRequested(0)
+{
+  size_t numVariants = 1;
+  for (int axis : m_axes)
+    numVariants *= axis;
+
+  m_programs.resize(numVariants);
+}
+
+size_t ShaderPermutations::indexOf(std::span<const int> coords) const
+{
+  size_t index = 0;
+  for (size_t i = 0; i < m_axes.size(); i++)
+    index = index * m_axes[i] + std::clamp(coords[i], 0, m_axes[i] - 1);
+  return index;
+}
+
+void ShaderPermutations::coordsOf(size_t index, std::span<int> coords) const
+{
+  for (size_t i = m_axes.size(); i-- > 0;)
+  {
+    coords[i] = (int)(index % m_axes[i]);
+    index /= m_axes[i];
+  }
+}
+
+ShaderProgram* ShaderPermutations::ensure(std::span<const int> coords)
+{
+  std::unique_ptr<ShaderProgram>& program = m_programs[indexOf(coords)];
+  if (!program)
+  {
+    program = m_builder(coords);
+    m_numRequested++;
+  }
+  return program.get();
+}
+
+void ShaderPermutations::request(std::initializer_list<int> coords)
+{
+  ensure(std::span<const int>(coords.begin(), coords.size()));
+}
+
+ShaderProgram* ShaderPermutations::get(std::initializer_list<int> coords, std::span<int> used)
+{
+  std::span<const int> wanted(coords.begin(), coords.size());
+  ShaderProgram* program = ensure(wanted);
+  size_t best = indexOf(wanted);
+
+  if (!program->isReady())
+  {
+    // Fall back to the closest variant that has finished linking.
+    std::vector<int> candidate(m_axes.size());
+    int bestDistance = INT_MAX;
+    ShaderProgram* fallback = nullptr;
+    for (size_t i = 0; i < m_programs.size(); i++)
+    {
+      if (!m_programs[i] || m_programs[i].get() == program || !m_programs[i]->isReady())
+        continue;
+
+      coordsOf(i, candidate);
+      int distance = 0;
+      for (size_t axis = 0; axis < m_axes.size(); axis++)
+        distance += std::abs(candidate[axis] - wanted[axis]);
+
+      if (distance < bestDistance)
+      {
+        bestDistance = distance;
+        best = i;
+        fallback = m_programs[i].get();
+      }
+    }
+
+    if (fallback)
+      program = fallback;
+    else
+      program->wait();
+  }
+
+  if (!used.empty())
+    coordsOf(best, used);
+
+  return program;
+}
+
+size_t ShaderPermutations::numReady() const
+{
+  size_t numReady = 0;
+  for (const std::unique_ptr<ShaderProgram>& program : m_programs)
+  {
+    if (program && program->isReady())
+      numReady++;
+  }
+  return numReady;
+}
@@ -0,0 +1,51 @@
+#ifndef _SHADERPERMUTATIONS_H
+#define _SHADERPERMUTATIONS_H
+#include <vector>
+#include <memory>
+#include <functional>
+#include <initializer_list>
+#include <span>
+#include "shader.h"
+
+// A grid of program variants with one axis per option, each compiled the first time it is
+// asked for. Links run asynchronously; until a variant is ready get() hands out the ready
+// variant closest to it, counting the steps along each axis. Only a request with nothing
+// ready to fall back on waits for its link.
+class ShaderPermutations
+{
+public:
+  // Builds the variant at `coords`, one index per axis. Should construct it async.
+  typedef std::function<std::unique_ptr<ShaderProgram>(std::span<const int> coords)> Builder;
+
+protected:
+  std::vector<int> m_axes;
+  Builder m_builder;
+  std::vector<std::unique_ptr<ShaderProgram>> m_programs;
+  size_t m_numRequested;
+
+public:
+  ShaderPermutations(std::initializer_list<int> axes, Builder builder);
+
+  // delete copy constructor
+  ShaderPermutations(const ShaderPermutations&) = delete;
+  ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+  // Starts compiling a variant ahead of its first use.
+  void request(std::initializer_list<int> coords);
+
+  // The variant at `coords` or the nearest ready one; `used` receives the coordinates of
+  // the returned variant when given.
+  ShaderProgram* get(std::initializer_list<int> coords, std::span<int> used = {});
+
+  inline size_t numVariants() const { return m_programs.size(); }
+  inline size_t numRequested() const { return m_numRequested; }
+  // Requested variants that have finished linking.
+  size_t numReady() const;
+
+protected:
+  size_t indexOf(std::span<const int> coords) const;
+  void coordsOf(size_t index, std::span<int> coords) const;
+  ShaderProgram* ensure(std::span<const int> coords);
+};
+
+#endif // _SHADERPERMUTATIONS_H
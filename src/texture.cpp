@@ -1,49 +1,169 @@
 #include "texture.h"
+#include "texturecache.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include <iostream>
+#include <algorithm>
 
-Texture::Texture(const std::string& path)
+TextureData::~TextureData()
+{
+  release();
+}
+
+bool TextureData::loadFromFile(const std::string& file, bool b16Bit)
+{
+  release();
+
+  path = file;
+  if (b16Bit && stbi_is_16_bit(path.c_str()))
+  {
+    bitDepth = 16;
+    pixels = (unsigned char*)stbi_load_16(path.c_str(), &width, &height, &nComponents, 0);
+  }
+  else
+  {
+    bitDepth = 8;
+    pixels = stbi_load(path.c_str(), &width, &height, &nComponents, 0);
+  }
+
+  if (!pixels)
+  {
+    std::cerr << "Failed to load image: " << path << "\n";
+    return false;
+  }
+
+  return true;
+}
+
+void TextureData::release()
+{
+  if (pixels)
+  {
+    stbi_image_free(pixels);
+    pixels = nullptr;
+  }
+}
+
+Texture::Texture(const std::string& path, TextureUsage usage)
+  : id(0)
+  , residentBytes(0)
+{
+  loadFromFile(path, usage);
+}
+
+Texture::Texture(const TextureData& data, TextureUsage usage)
   : id(0)
+  , residentBytes(0)
 {
-  loadFromFile(path);
+  create(data, usage);
 }
 
 Texture::~Texture()
 {
-  std::cout << "DEBUG: Delete texture " << id << "\n";
-  glDeleteTextures(1, &id);
+  // A streamed texture owns its id once the streamer has uploaded the mip tail, before that
+  // the streamer does. The finer levels keep streaming into the id after the handover.
+  GLuint texture = getId();
+  std::cout << "DEBUG: Delete texture " << texture << "\n";
+  glDeleteTextures(1, &texture);
 }
 
 void Texture::bind(void) const
 {
-  glBindTexture(GL_TEXTURE_2D, id);
+  GLuint texture = getId();
+  glBindTexture(GL_TEXTURE_2D, texture ? texture : placeholder());
 }
 
-void Texture::loadFromFile(const std::string& path)
+GLuint Texture::placeholder()
 {
-  int w, h, nComponents;
-  stbi_uc* data = stbi_load(path.c_str(), &w, &h, &nComponents, 0);
-  if (!data)
+  static GLuint s_placeholder = 0;
+  if (!s_placeholder)
   {
-    std::cerr << "Failed to load image: " << path << "\n";
+    const unsigned char grey[4] = { 128, 128, 128, 255 };
+    glCreateTextures(GL_TEXTURE_2D, 1, &s_placeholder);
+    glTextureStorage2D(s_placeholder, 1, GL_RGBA8, 1, 1);
+    glTextureSubImage2D(s_placeholder, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+  }
+
+  return s_placeholder;
+}
+
+size_t Texture::mipChainBytes(int width, int height, size_t bytesPerTexel)
+{
+  size_t bytes = 0;
+  for (;;)
+  {
+    bytes += (size_t)width * height * bytesPerTexel;
+    if (width == 1 && height == 1)
+      return bytes;
+
+    width = std::max(width / 2, 1);
+    height = std::max(height / 2, 1);
+  }
+}
+
+GLuint Texture::createStorage(TextureEncoding encoding, TextureUsage usage, int numLevels, int width, int height)
+{
+  GLuint texture = 0;
+  glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+  glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // Single channel storage reads as grey, two channels as grey and alpha.
+  int numChannels = BlockCompress::numChannels(encoding);
+  if (numChannels <= 2)
+  {
+    const GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, numChannels == 1 ? GL_ONE : GL_GREEN };
+    glTextureParameteriv(texture, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+  }
+
+  glTextureStorage2D(texture, numLevels, TextureCache::internalFormat(encoding, usage), width, height);
+  return texture;
+}
+
+void Texture::uploadLevel(GLuint texture, TextureEncoding encoding, TextureUsage usage, int level, int width, int height, size_t size, const void* pixels)
+{
+  if (BlockCompress::isCompressed(encoding))
+  {
+    glCompressedTextureSubImage2D(texture, level, 0, 0, width, height, TextureCache::internalFormat(encoding, usage), (GLsizei)size, pixels);
     return;
   }
 
-  glGenTextures(1, &id);
-  glBindTexture(GL_TEXTURE_2D, id);
+  // Levels are tightly packed, rows of one and three byte texels are not 4 byte aligned.
+  GLenum format, type;
+  TextureCache::pixelFormat(encoding, format, type);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTextureSubImage2D(texture, level, 0, 0, width, height, format, type, pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void Texture::loadFromFile(const std::string& path, TextureUsage usage)
+{
+  TextureData data;
+  if (!data.loadFromFile(path, TextureCache::wants16Bit(usage)))
+    return;
+
+  create(data, usage);
+}
 
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void Texture::create(const TextureData& data, TextureUsage usage)
+{
+  if (!data.isLoaded())
+    return;
 
-  // nComponents == 3 ? GL_RGB : 
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, nComponents == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, data);
-  glGenerateMipmap(GL_TEXTURE_2D);
+  TextureLevels levels;
+  TextureCache::build(data, TextureCache::chooseEncoding(data, usage, TextureCompression::None, false), usage, levels);
 
-  glBindTexture(GL_TEXTURE_2D, 0);
-  stbi_image_free(data);
-}
\ No newline at end of file
+  const TextureLevel& base = levels.levels[0];
+  id = createStorage(levels.encoding, usage, (int)levels.levels.size(), base.width, base.height);
+  for (size_t i = 0; i < levels.levels.size(); i++)
+  {
+    const TextureLevel& level = levels.levels[i];
+    uploadLevel(id, levels.encoding, usage, (int)i, level.width, level.height, level.data.size(), level.data.data());
+  }
+
+  residentBytes = levels.size();
+}
@@ -2,15 +2,81 @@
 #define _TEXTURE_H
 #include <glad/glad.h>
 #include <string>
+#include <memory>
+#include <cstdint>
+#include "blockcompress.h"
+
+// What an image holds, which decides how it is stored. Color is sRGB and always has four
+// channels, displacement keeps one channel at the source bit depth, masks are linear and
+// keep the source channels. HeightDerivatives bakes a heightmap into height and its uv
+// derivatives for displacement with a single fetch.
+enum class TextureUsage : uint32_t
+{
+  Color,
+  Displacement,
+  Mask,
+  HeightDerivatives,
+
+  Count
+};
+
+// Decoded image pixels, produced off the GL thread and uploaded by Texture. 16 bit images
+// hold unsigned shorts in `pixels`.
+struct TextureData
+{
+  std::string path;
+  int width;
+  int height;
+  int nComponents;
+  int bitDepth;
+  unsigned char* pixels;
+
+  inline TextureData() : width(0), height(0), nComponents(0), bitDepth(8), pixels(nullptr) { }
+  ~TextureData();
+
+  inline TextureData(TextureData&& rhs) noexcept;
+  inline TextureData& operator=(TextureData&& rhs) noexcept;
+
+  // delete copy constructor
+  TextureData(const TextureData&) = delete;
+  TextureData& operator=(const TextureData&) = delete;
+
+  // 16 bit sources keep their precision only when b16Bit is set, otherwise they are
+  // converted to 8 bits.
+  bool loadFromFile(const std::string& path, bool b16Bit = false);
+  void release();
+
+  inline bool isLoaded() const { return pixels != nullptr; }
+};
+
+// Filled in by TextureStreamer once a texture's mip tail is uploaded, residentBytes grows
+// as finer levels land.
+struct StreamedTexture
+{
+  GLuint id;
+  size_t residentBytes;
+  bool bComplete;
+  bool bFailed;
+
+  inline StreamedTexture() : id(0), residentBytes(0), bComplete(false), bFailed(false) { }
+};
 
 class Texture
 {
+  friend class TextureStreamer;
+
 protected:
   GLuint id;
+  size_t residentBytes;
+
+  // Set for textures handed out by TextureStreamer. Until the mip tail is uploaded bind()
+  // binds a placeholder.
+  std::shared_ptr<StreamedTexture> streamed;
 
 public:
-  inline Texture() : id(0) { }
-  Texture(const std::string& path);
+  inline Texture() : id(0), residentBytes(0) { }
+  Texture(const std::string& path, TextureUsage usage = TextureUsage::Color);
+  Texture(const TextureData& data, TextureUsage usage = TextureUsage::Color);
   ~Texture();
 
   inline Texture(Texture&& rhs) noexcept;
@@ -22,13 +88,62 @@ public:
 
   void bind(void) const;
 
+  inline GLuint getId() const { return id ? id : (streamed ? streamed->id : 0); }
+  inline bool isReady() const { return getId() != 0; }
+
+  // Every mip level is uploaded, or the image could not be loaded and never will be.
+  inline bool isComplete() const { return id ? true : (streamed && streamed->bComplete); }
+  inline bool isFailed() const { return streamed ? streamed->bFailed : id == 0; }
+
+  // Video memory held by the texture and its mip chain, 0 until it is ready.
+  inline size_t getResidentBytes() const { return id ? residentBytes : (streamed ? streamed->residentBytes : 0); }
+  static size_t mipChainBytes(int width, int height, size_t bytesPerTexel);
+
+  // Create a texture with immutable storage for `numLevels` mips, then fill each level
+  // with uploadLevel(). Pixels come from the bound pixel unpack buffer if there is one.
+  static GLuint createStorage(TextureEncoding encoding, TextureUsage usage, int numLevels, int width, int height);
+  static void uploadLevel(GLuint id, TextureEncoding encoding, TextureUsage usage, int level, int width, int height, size_t size, const void* pixels);
+
+  // 1x1 texture bound in place of textures that are still streaming in.
+  static GLuint placeholder();
+
 protected:
-  void loadFromFile(const std::string& path);
+  void loadFromFile(const std::string& path, TextureUsage usage);
+  void create(const TextureData& data, TextureUsage usage);
 };
 
 
+TextureData::TextureData(TextureData&& rhs) noexcept
+  : path(std::move(rhs.path))
+  , width(rhs.width)
+  , height(rhs.height)
+  , nComponents(rhs.nComponents)
+  , bitDepth(rhs.bitDepth)
+  , pixels(rhs.pixels)
+{
+  rhs.pixels = nullptr;
+}
+
+TextureData& TextureData::operator=(TextureData&& rhs) noexcept
+{
+  release();
+
+  path = std::move(rhs.path);
+  width = rhs.width;
+  height = rhs.height;
+  nComponents = rhs.nComponents;
+  bitDepth = rhs.bitDepth;
+
+  pixels = rhs.pixels;
+  rhs.pixels = nullptr;
+
+  return *this;
+}
+
 Texture::Texture(Texture&& rhs) noexcept
   : id(rhs.id)
+  , residentBytes(rhs.residentBytes)
+  , streamed(std::move(rhs.streamed))
 {
   rhs.id = 0;
 }
@@ -37,6 +152,9 @@ Texture& Texture::operator=(Texture&& rhs) noexcept
 {
   id = rhs.id;
   rhs.id = 0;
+  residentBytes = rhs.residentBytes;
+  streamed = std::move(rhs.streamed);
+  return *this;
 }
 
-#endif // _TEXTURE_H
\ No newline at end of file
+#endif // _TEXTURE_H
@@ -0,0 +1,465 @@
+#include "texturecache.h"
+#include "heightbaker.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <format>
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+
+#ifndef TEXTURE_CACHE_DIR
+#define TEXTURE_CACHE_DIR "cache"
+#endif // TEXTURE_CACHE_DIR
+
+static const uint32_t TEXTURE_CACHE_MAGIC = 0x43584554; // 'TEXC'
+static const uint32_t TEXTURE_CACHE_VERSION = 3;
+static const size_t TEXTURE_CACHE_ALIGN = 16;
+
+static uint64_t fnv1a(const void* data, size_t len, uint64_t hash = 0xcbf29ce484222325ull)
+{
+  const unsigned char* bytes = (const unsigned char*)data;
+  for (size_t i = 0; i < len; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static inline uint64_t alignOffset(uint64_t offset)
+{
+  return (offset + (TEXTURE_CACHE_ALIGN - 1)) & ~(uint64_t)(TEXTURE_CACHE_ALIGN - 1);
+}
+
+static int64_t sourceTime(const std::string& source)
+{
+  std::error_code ec;
+  auto time = std::filesystem::last_write_time(source, ec);
+  if (ec)
+    return 0;
+  return (int64_t)time.time_since_epoch().count();
+}
+
+static inline float srgbToLinear(float c)
+{
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline float linearToSRGB(float c)
+{
+  return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static inline uint8_t quantize8(float c)
+{
+  return (uint8_t)(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Expand 8 or 16 bit pixels with 1-4 channels to RGBA floats, grey is replicated into
+// rgb. Color is linearized.
+static void expandToRGBA(const TextureData& image, bool bSRGB, float* out)
+{
+  const size_t numTexels = (size_t)image.width * image.height;
+  const float scale = image.bitDepth == 16 ? 1.0f / 65535.0f : 1.0f / 255.0f;
+  const unsigned short* pixels16 = (const unsigned short*)image.pixels;
+
+  for (size_t i = 0; i < numTexels; i++)
+  {
+    float src[4] = { 0, 0, 0, 1 };
+    for (int c = 0; c < image.nComponents; c++)
+    {
+      size_t index = i * image.nComponents + c;
+      src[c] = (image.bitDepth == 16 ? pixels16[index] : image.pixels[index]) * scale;
+    }
+
+    float* dst = out + i * 4;
+    switch (image.nComponents)
+    {
+    case 1: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 1.0f; break;
+    case 2: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+    default: memcpy(dst, src, sizeof(src)); break;
+    }
+
+    if (bSRGB)
+    {
+      for (int c = 0; c < 3; c++)
+        dst[c] = srgbToLinear(dst[c]);
+    }
+  }
+}
+
+// Quantize a level for BlockCompress. Two channel storage of grey-alpha images holds grey
+// in red and alpha in green.
+static void packRGBA8(const float* texels, size_t numTexels, bool bSRGB, bool bGreyAlpha, uint8_t* out)
+{
+  for (size_t i = 0; i < numTexels; i++)
+  {
+    const float* src = texels + i * 4;
+    uint8_t* dst = out + i * 4;
+    for (int c = 0; c < 3; c++)
+      dst[c] = quantize8(bSRGB ? linearToSRGB(src[c]) : src[c]);
+    dst[3] = quantize8(src[3]);
+
+    if (bGreyAlpha)
+    {
+      dst[1] = dst[3];
+      dst[2] = 0;
+      dst[3] = 255;
+    }
+  }
+}
+
+static void packR16(const float* texels, size_t numTexels, uint8_t* out)
+{
+  for (size_t i = 0; i < numTexels; i++)
+  {
+    uint16_t value = (uint16_t)(std::clamp(texels[i * 4], 0.0f, 1.0f) * 65535.0f + 0.5f);
+    memcpy(out + i * 2, &value, 2);
+  }
+}
+
+static void packRGBA16F(const float* texels, size_t numTexels, uint8_t* out)
+{
+  for (size_t i = 0; i < numTexels * 4; i++)
+  {
+    uint16_t value = glm::packHalf1x16(texels[i]);
+    memcpy(out + i * 2, &value, 2);
+  }
+}
+
+// 2x2 box filter, the last row and column repeat for odd sizes.
+static void downsample(const float* src, int width, int height, float* dst, int dstWidth, int dstHeight)
+{
+  for (int y = 0; y < dstHeight; y++)
+  {
+    int y0 = std::min(2 * y, height - 1);
+    int y1 = std::min(2 * y + 1, height - 1);
+    for (int x = 0; x < dstWidth; x++)
+    {
+      int x0 = std::min(2 * x, width - 1);
+      int x1 = std::min(2 * x + 1, width - 1);
+      for (int c = 0; c < 4; c++)
+      {
+        float sum = src[((size_t)y0 * width + x0) * 4 + c] + src[((size_t)y0 * width + x1) * 4 + c]
+          + src[((size_t)y1 * width + x0) * 4 + c] + src[((size_t)y1 * width + x1) * 4 + c];
+        dst[((size_t)y * dstWidth + x) * 4 + c] = sum * 0.25f;
+      }
+    }
+  }
+}
+
+size_t TextureLevels::size() const
+{
+  size_t bytes = 0;
+  for (const TextureLevel& level : levels)
+    bytes += level.data.size();
+  return bytes;
+}
+
+TextureEncoding TextureCache::chooseEncoding(const TextureData& image, TextureUsage usage, TextureCompression compression, bool bAllowBC1)
+{
+  const bool bBlock = compression == TextureCompression::Block;
+  switch (usage)
+  {
+  case TextureUsage::HeightDerivatives:
+    return TextureEncoding::RGBA16F;
+
+  case TextureUsage::Displacement:
+    if (image.bitDepth == 16)
+      return TextureEncoding::R16;
+    return bBlock ? TextureEncoding::BC4 : TextureEncoding::R8;
+
+  case TextureUsage::Color:
+    if (!bBlock)
+      return TextureEncoding::RGBA8;
+    return image.nComponents == 3 && bAllowBC1 ? TextureEncoding::BC1 : TextureEncoding::BC7;
+
+  default:
+    switch (image.nComponents)
+    {
+    case 1: return bBlock ? TextureEncoding::BC4 : TextureEncoding::R8;
+    case 2: return bBlock ? TextureEncoding::BC5 : TextureEncoding::RG8;
+    case 3: return bBlock ? (bAllowBC1 ? TextureEncoding::BC1 : TextureEncoding::BC7) : TextureEncoding::RGB8;
+    default: return bBlock ? TextureEncoding::BC7 : TextureEncoding::RGBA8;
+    }
+  }
+}
+
+GLenum TextureCache::internalFormat(TextureEncoding encoding, TextureUsage usage)
+{
+  const bool bSRGB = usage == TextureUsage::Color;
+  switch (encoding)
+  {
+  case TextureEncoding::R8: return GL_R8;
+  case TextureEncoding::RG8: return GL_RG8;
+  case TextureEncoding::RGB8: return bSRGB ? GL_SRGB8 : GL_RGB8;
+  case TextureEncoding::R16: return GL_R16;
+  case TextureEncoding::RGBA16F: return GL_RGBA16F;
+  case TextureEncoding::BC1: return bSRGB ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  case TextureEncoding::BC4: return GL_COMPRESSED_RED_RGTC1;
+  case TextureEncoding::BC5: return GL_COMPRESSED_RG_RGTC2;
+  case TextureEncoding::BC7: return bSRGB ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+  default: return bSRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+  }
+}
+
+void TextureCache::pixelFormat(TextureEncoding encoding, GLenum& format, GLenum& type)
+{
+  switch (encoding)
+  {
+  case TextureEncoding::R16: type = GL_UNSIGNED_SHORT; break;
+  case TextureEncoding::RGBA16F: type = GL_HALF_FLOAT; break;
+  default: type = GL_UNSIGNED_BYTE; break;
+  }
+
+  switch (BlockCompress::numChannels(encoding))
+  {
+  case 1: format = GL_RED; break;
+  case 2: format = GL_RG; break;
+  case 3: format = GL_RGB; break;
+  default: format = GL_RGBA; break;
+  }
+}
+
+void TextureCache::build(const TextureData& image, TextureEncoding encoding, TextureUsage usage, TextureLevels& levels)
+{
+  levels.encoding = encoding;
+  levels.nComponents = image.nComponents;
+  levels.levels.clear();
+
+  // Lay out every level first, the spans point into storage.
+  std::vector<size_t> offsets;
+  size_t size = 0;
+  for (int width = image.width, height = image.height;; width = std::max(width / 2, 1), height = std::max(height / 2, 1))
+  {
+    offsets.push_back(size);
+    levels.levels.push_back({ width, height, {} });
+    size = alignOffset(size + BlockCompress::encodedSize(encoding, width, height));
+    if (width == 1 && height == 1)
+      break;
+  }
+  levels.storage.resize(size);
+
+  const bool bSRGB = usage == TextureUsage::Color;
+  const bool bGreyAlpha = image.nComponents == 2 && BlockCompress::numChannels(encoding) == 2;
+
+  std::vector<float> texels((size_t)image.width * image.height * 4);
+  std::vector<float> next;
+  std::vector<uint8_t> rgba;
+  expandToRGBA(image, bSRGB, texels.data());
+
+  // Derivatives are baked at full resolution and filtered down with the heights, the box
+  // filter is linear so each mip holds the derivatives of its own heights.
+  if (usage == TextureUsage::HeightDerivatives)
+  {
+    std::vector<float> heights((size_t)image.width * image.height);
+    for (size_t i = 0; i < heights.size(); i++)
+      heights[i] = texels[i * 4];
+
+    HeightBaker::bake(heights.data(), image.width, image.height, texels.data());
+  }
+
+  for (size_t i = 0; i < levels.levels.size(); i++)
+  {
+    TextureLevel& level = levels.levels[i];
+    const size_t numTexels = (size_t)level.width * level.height;
+    uint8_t* out = levels.storage.data() + offsets[i];
+    if (encoding == TextureEncoding::R16)
+    {
+      packR16(texels.data(), numTexels, out);
+    }
+    else if (encoding == TextureEncoding::RGBA16F)
+    {
+      packRGBA16F(texels.data(), numTexels, out);
+    }
+    else
+    {
+      rgba.resize(numTexels * 4);
+      packRGBA8(texels.data(), numTexels, bSRGB, bGreyAlpha, rgba.data());
+      BlockCompress::encodeImage(encoding, rgba.data(), level.width, level.height, out);
+    }
+    level.data = std::span<const uint8_t>(out, BlockCompress::encodedSize(encoding, level.width, level.height));
+
+    if (i + 1 < levels.levels.size())
+    {
+      const TextureLevel& nextLevel = levels.levels[i + 1];
+      next.resize((size_t)nextLevel.width * nextLevel.height * 4);
+      downsample(texels.data(), level.width, level.height, next.data(), nextLevel.width, nextLevel.height);
+      texels.swap(next);
+    }
+  }
+}
+
+std::string TextureCache::cachePath(const std::string& source, TextureUsage usage, TextureCompression compression)
+{
+  uint64_t hash = fnv1a(source.data(), source.size());
+  uint64_t kind = (uint64_t)usage << 32 | (uint64_t)compression;
+  hash = fnv1a(&kind, sizeof(kind), hash);
+
+  std::string name = std::filesystem::path(source).stem().string() + std::format("_{:016x}.texcache", hash);
+  return (std::filesystem::path(TEXTURE_CACHE_DIR) / name).string();
+}
+
+bool TextureCache::open(const std::string& source, TextureUsage usage, TextureCompression compression)
+{
+  close();
+
+  std::string path = cachePath(source, usage, compression);
+  if (!std::filesystem::exists(path) || !m_file.open(path))
+    return false;
+
+  const char* base = (const char*)m_file.data();
+  size_t size = m_file.size();
+
+  const Header* header = (const Header*)base;
+  if (size < sizeof(Header)
+    || header->magic != TEXTURE_CACHE_MAGIC
+    || header->version != TEXTURE_CACHE_VERSION
+    || header->usage != (uint32_t)usage
+    || header->compression != (uint32_t)compression
+    || header->encoding >= (uint32_t)TextureEncoding::Count
+    || header->sourceTime != sourceTime(source))
+  {
+    m_file.close();
+    return false;
+  }
+
+  // Guard against hash collisions between source paths.
+  if (header->sourcePathOffset + header->sourcePathLen > size
+    || source.size() != header->sourcePathLen
+    || memcmp(base + header->sourcePathOffset, source.data(), source.size()) != 0)
+  {
+    m_file.close();
+    return false;
+  }
+
+  const LevelEntry* levels = (const LevelEntry*)(base + sizeof(Header));
+  if (header->numLevels == 0 || sizeof(Header) + sizeof(LevelEntry) * header->numLevels > size)
+  {
+    std::cerr << "TextureCache::open> Truncated cache file: " << path << "\n";
+    m_file.close();
+    return false;
+  }
+
+  for (uint32_t i = 0; i < header->numLevels; i++)
+  {
+    if (levels[i].offset + levels[i].size > size
+      || levels[i].size != BlockCompress::encodedSize((TextureEncoding)header->encoding, levels[i].width, levels[i].height))
+    {
+      std::cerr << "TextureCache::open> Truncated cache file: " << path << "\n";
+      m_file.close();
+      return false;
+    }
+  }
+
+  m_header = header;
+  m_levels = levels;
+  return true;
+}
+
+void TextureCache::close()
+{
+  m_file.close();
+  m_header = nullptr;
+  m_levels = nullptr;
+}
+
+void TextureCache::getLevels(TextureLevels& levels) const
+{
+  const uint8_t* base = (const uint8_t*)m_file.data();
+
+  levels.encoding = (TextureEncoding)m_header->encoding;
+  levels.nComponents = (int)m_header->nComponents;
+  levels.storage.clear();
+  levels.levels.resize(m_header->numLevels);
+  for (uint32_t i = 0; i < m_header->numLevels; i++)
+  {
+    const LevelEntry& entry = m_levels[i];
+    levels.levels[i] = { (int)entry.width, (int)entry.height, std::span<const uint8_t>(base + entry.offset, entry.size) };
+  }
+}
+
+bool TextureCache::write(const std::string& source, TextureUsage usage, TextureCompression compression, const TextureLevels& levels)
+{
+  std::string path = cachePath(source, usage, compression);
+
+  std::error_code ec;
+  std::filesystem::create_directories(TEXTURE_CACHE_DIR, ec);
+
+  // Lay out the file: header, level table, source path, then aligned levels.
+  Header header = {};
+  header.magic = TEXTURE_CACHE_MAGIC;
+  header.version = TEXTURE_CACHE_VERSION;
+  header.sourceTime = sourceTime(source);
+  header.usage = (uint32_t)usage;
+  header.compression = (uint32_t)compression;
+  header.encoding = (uint32_t)levels.encoding;
+  header.nComponents = (uint32_t)levels.nComponents;
+  header.numLevels = (uint32_t)levels.levels.size();
+
+  uint64_t offset = sizeof(Header) + sizeof(LevelEntry) * levels.levels.size();
+  header.sourcePathOffset = offset;
+  header.sourcePathLen = (uint32_t)source.size();
+  offset += source.size();
+
+  std::vector<LevelEntry> entries(levels.levels.size());
+  for (size_t i = 0; i < levels.levels.size(); i++)
+  {
+    offset = alignOffset(offset);
+    entries[i].offset = offset;
+    entries[i].size = levels.levels[i].data.size();
+    entries[i].width = (uint32_t)levels.levels[i].width;
+    entries[i].height = (uint32_t)levels.levels[i].height;
+    offset += entries[i].size;
+  }
+
+  // Write to a temporary file first so a crash never leaves a half-written cache behind.
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!ofs)
+    {
+      std::cerr << "TextureCache::write> Failed to open " << tmpPath << "\n";
+      return false;
+    }
+
+    uint64_t written = 0;
+    auto put = [&](const void* data, size_t len) {
+      ofs.write((const char*)data, len);
+      written += len;
+    };
+    auto pad = [&](uint64_t to) {
+      static const char zeros[TEXTURE_CACHE_ALIGN] = { 0 };
+      while (written < to)
+        put(zeros, std::min<uint64_t>(to - written, TEXTURE_CACHE_ALIGN));
+    };
+
+    put(&header, sizeof(header));
+    put(entries.data(), entries.size() * sizeof(LevelEntry));
+    put(source.data(), source.size());
+    for (size_t i = 0; i < levels.levels.size(); i++)
+    {
+      pad(entries[i].offset);
+      put(levels.levels[i].data.data(), levels.levels[i].data.size());
+    }
+
+    if (!ofs)
+    {
+      std::cerr << "TextureCache::write> Failed to write " << tmpPath << "\n";
+      return false;
+    }
+  }
+
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+  {
+    std::cerr << "TextureCache::write> Failed to move cache into place: " << ec.message() << "\n";
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+
+  std::cout << "Wrote texture cache '" << path << "'\n";
+  return true;
+}
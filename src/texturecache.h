@@ -0,0 +1,119 @@
+#ifndef _TEXTURECACHE_H
+#define _TEXTURECACHE_H
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdint>
+#include "blockcompress.h"
+#include "mappedfile.h"
+#include "texture.h"
+
+// BC1 is not part of core GL, TextureStreamer checks for EXT_texture_compression_s3tc and
+// EXT_texture_sRGB.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif // GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+
+// How a texture may be stored. Block compressed textures pick BC4, BC5, BC1 or BC7 by
+// usage and the source's channel count.
+enum class TextureCompression : uint32_t
+{
+  None,
+  Block,
+
+  Count
+};
+
+struct TextureLevel
+{
+  int width;
+  int height;
+  std::span<const uint8_t> data;
+};
+
+// A complete mip chain in its GL storage format. Levels point into `storage` when built in
+// memory, or into a mapped TextureCache.
+struct TextureLevels
+{
+  TextureEncoding encoding;
+  int nComponents;
+  std::vector<TextureLevel> levels;
+  std::vector<uint8_t> storage;
+
+  inline TextureLevels() : encoding(TextureEncoding::RGBA8), nComponents(0) { }
+
+  size_t size() const;
+};
+
+// Versioned binary cache of finished textures, keyed by source path, source mtime, usage
+// and the compression setting. Holds the whole mip chain in the final GL format, so a warm start
+// maps the file and uploads it level by level without decoding or generating mips.
+class TextureCache
+{
+public:
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    int64_t sourceTime;
+    uint32_t compression;
+    uint32_t encoding;
+    uint32_t nComponents;
+    uint32_t numLevels;
+    uint64_t sourcePathOffset;
+    uint32_t sourcePathLen;
+    uint32_t usage;
+  };
+
+  struct LevelEntry
+  {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+  };
+
+protected:
+  MappedFile m_file;
+  const Header* m_header;
+  const LevelEntry* m_levels;
+
+public:
+  TextureCache() : m_header(nullptr), m_levels(nullptr) { }
+
+  // Map the cache file for `source`, returns false if missing or stale.
+  bool open(const std::string& source, TextureUsage usage, TextureCompression compression);
+  void close();
+
+  inline bool isOpen() const { return m_header != nullptr; }
+  inline TextureEncoding encoding() const { return (TextureEncoding)m_header->encoding; }
+
+  // Levels pointing into the mapping, valid while the cache stays open.
+  void getLevels(TextureLevels& levels) const;
+
+  static bool write(const std::string& source, TextureUsage usage, TextureCompression compression, const TextureLevels& levels);
+
+  // Build the mip chain of a decoded image and encode every level. Color mips are averaged
+  // in linear space.
+  static void build(const TextureData& image, TextureEncoding encoding, TextureUsage usage, TextureLevels& levels);
+
+  // Displacement is R8 or R16 by source bit depth, color RGBA8 and masks keep the source
+  // channels, unless block compression is asked for. Height derivatives are RGBA16F.
+  static TextureEncoding chooseEncoding(const TextureData& image, TextureUsage usage, TextureCompression compression, bool bAllowBC1);
+
+  // Heights keep 16 bit sources at full precision.
+  static inline bool wants16Bit(TextureUsage usage) { return usage == TextureUsage::Displacement || usage == TextureUsage::HeightDerivatives; }
+  static GLenum internalFormat(TextureEncoding encoding, TextureUsage usage);
+  static void pixelFormat(TextureEncoding encoding, GLenum& format, GLenum& type);
+  static std::string cachePath(const std::string& source, TextureUsage usage, TextureCompression compression);
+
+  // delete copy constructor
+  TextureCache(const TextureCache&) = delete;
+  TextureCache& operator=(const TextureCache&) = delete;
+};
+
+#endif // _TEXTURECACHE_H
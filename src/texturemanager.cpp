@@ -0,0 +1,79 @@
+#include "texturemanager.h"
+#include "texturestreamer.h"
+#include <filesystem>
+#include <algorithm>
+
+TextureManager::TextureManager()
+  : m_numHits(0)
+  , m_numMisses(0)
+{
+}
+
+TextureManager& TextureManager::global()
+{
+  static TextureManager s_manager;
+  return s_manager;
+}
+
+std::string TextureManager::canonicalPath(const std::string& path)
+{
+  // Material libraries written on Windows use backslashes.
+  std::string generic = path;
+  std::replace(generic.begin(), generic.end(), '\\', '/');
+
+  std::error_code error;
+  std::filesystem::path canonical = std::filesystem::weakly_canonical(generic, error);
+  if (error)
+    canonical = std::filesystem::path(generic).lexically_normal();
+
+  return canonical.generic_string();
+}
+
+std::shared_ptr<Texture> TextureManager::acquire(const std::string& path, TextureUsage usage, TextureCompression compression)
+{
+  std::string canonical = canonicalPath(path);
+  std::string key = canonical + '#' + std::to_string((int)usage) + '#' + std::to_string((int)compression);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::weak_ptr<Texture>& entry = m_textures[key];
+  if (std::shared_ptr<Texture> texture = entry.lock())
+  {
+    m_numHits++;
+    return texture;
+  }
+
+  m_numMisses++;
+  std::shared_ptr<Texture> texture = TextureStreamer::global().load(canonical, usage, compression);
+  entry = texture;
+  return texture;
+}
+
+size_t TextureManager::numTextures()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t count = 0;
+  for (auto it = m_textures.begin(); it != m_textures.end();)
+  {
+    if (it->second.expired())
+    {
+      it = m_textures.erase(it);
+      continue;
+    }
+
+    count++;
+    ++it;
+  }
+  return count;
+}
+
+size_t TextureManager::residentBytes()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t bytes = 0;
+  for (const auto& [path, entry] : m_textures)
+  {
+    if (std::shared_ptr<Texture> texture = entry.lock())
+      bytes += texture->getResidentBytes();
+  }
+  return bytes;
+}
@@ -0,0 +1,46 @@
+#ifndef _TEXTUREMANAGER_H
+#define _TEXTUREMANAGER_H
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "texture.h"
+#include "texturecache.h"
+
+// Shared textures keyed by canonical path, so every image is decoded and resident once no
+// matter how many materials use it. Entries hold weak references: a texture is released
+// when its last handle goes away and streamed in again on the next acquire(). The same
+// image requested with a different usage or compression is a separate texture.
+//
+// acquire() creates GL objects and must be called on the GL thread.
+class TextureManager
+{
+protected:
+  std::mutex m_mutex;
+  std::unordered_map<std::string, std::weak_ptr<Texture>> m_textures;
+  size_t m_numHits;
+  size_t m_numMisses;
+
+public:
+  TextureManager();
+
+  // delete copy constructor
+  TextureManager(const TextureManager&) = delete;
+  TextureManager& operator=(const TextureManager&) = delete;
+
+  std::shared_ptr<Texture> acquire(const std::string& path, TextureUsage usage, TextureCompression compression = TextureCompression::None);
+
+  inline size_t numHits() const { return m_numHits; }
+  inline size_t numMisses() const { return m_numMisses; }
+
+  // Live textures and the video memory of those that have finished uploading.
+  size_t numTextures();
+  size_t residentBytes();
+
+  // Forward slashes, no "." or ".." and symlinks resolved where the file exists.
+  static std::string canonicalPath(const std::string& path);
+
+  static TextureManager& global();
+};
+
+#endif // _TEXTUREMANAGER_H
@@ -0,0 +1,429 @@
+#include "texturestreamer.h"
+#include "threadpool.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+static const GLbitfield RING_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+static bool hasExtension(const char* name)
+{
+  GLint numExtensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+  for (GLint i = 0; i < numExtensions; i++)
+  {
+    if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+      return true;
+  }
+  return false;
+}
+
+TextureStreamer::TextureStreamer()
+  : m_ringBuffer(0)
+  , m_ringData(nullptr)
+  , m_bAllowBC1(false)
+  , m_ringHead(0)
+  , m_numDecoding(0)
+  , m_uploadBudget(DEFAULT_UPLOAD_BUDGET)
+  , m_numUploaded(0)
+  , m_uploadedBytes(0)
+{
+  glCreateBuffers(1, &m_ringBuffer);
+  glNamedBufferStorage(m_ringBuffer, RING_SIZE, nullptr, RING_FLAGS);
+  m_ringData = (unsigned char*)glMapNamedBufferRange(m_ringBuffer, 0, RING_SIZE, RING_FLAGS);
+  if (!m_ringData)
+    std::cerr << "TextureStreamer: Failed to map the staging ring, uploading from client memory.\n";
+
+  // BC1 is only chosen for color, which needs the sRGB variant as well.
+  m_bAllowBC1 = hasExtension("GL_EXT_texture_compression_s3tc") && hasExtension("GL_EXT_texture_sRGB");
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  shutdown();
+}
+
+TextureStreamer& TextureStreamer::global()
+{
+  static TextureStreamer s_streamer;
+  return s_streamer;
+}
+
+std::unique_ptr<Texture> TextureStreamer::load(const std::string& path, TextureUsage usage, TextureCompression compression)
+{
+  auto texture = std::make_unique<Texture>();
+  texture->streamed = std::make_shared<StreamedTexture>();
+
+  auto request = std::make_shared<Request>();
+  request->path = path;
+  request->usage = usage;
+  request->compression = compression;
+  request->texture = texture->streamed;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_numDecoding++;
+  }
+
+  ThreadPool::global().submit([this, request] { decode(request); });
+  return texture;
+}
+
+void TextureStreamer::decode(std::shared_ptr<Request> request)
+{
+  // Warm starts map the finished mip chain, cold starts decode and build it once.
+  TextureCache cache;
+  TextureLevels levels;
+  if (cache.open(request->path, request->usage, request->compression) && (cache.encoding() != TextureEncoding::BC1 || m_bAllowBC1))
+  {
+    cache.getLevels(levels);
+  }
+  else
+  {
+    cache.close();
+
+    std::cout << "Loading texture '" << request->path << "'\n";
+    TextureData image;
+    if (image.loadFromFile(request->path, TextureCache::wants16Bit(request->usage)))
+    {
+      TextureEncoding encoding = TextureCache::chooseEncoding(image, request->usage, request->compression, m_bAllowBC1);
+      TextureCache::build(image, encoding, request->usage, levels);
+      TextureCache::write(request->path, request->usage, request->compression, levels);
+    }
+    else
+    {
+      request->bFailed = true;
+    }
+  }
+
+  if (!request->bFailed)
+    stage(*request, levels);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_staged.push_back(std::move(request));
+    m_numDecoding--;
+  }
+  m_decodeDone.notify_all();
+}
+
+void TextureStreamer::stage(Request& request, const TextureLevels& levels)
+{
+  request.encoding = levels.encoding;
+  request.baseLevel = (int)levels.levels.size();
+
+  size_t size = 0;
+  request.levels.resize(levels.levels.size());
+  for (size_t i = 0; i < levels.levels.size(); i++)
+  {
+    const TextureLevel& level = levels.levels[i];
+    request.levels[i] = { size, level.data.size(), (uint32_t)level.width, (uint32_t)level.height };
+    size = (size + level.data.size() + RING_ALIGNMENT - 1) & ~(RING_ALIGNMENT - 1);
+  }
+  request.size = size;
+
+  size_t offset = 0;
+  if (m_ringData)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    request.bInRing = allocateRing(size, offset);
+  }
+
+  // Copy into the mapped ring here so the GL thread only issues the upload. Without
+  // space the levels wait in client memory and update() stages them later.
+  uint8_t* dst;
+  if (request.bInRing)
+  {
+    request.ringOffset = offset;
+    dst = m_ringData + offset;
+  }
+  else
+  {
+    request.pixels.resize(size);
+    dst = request.pixels.data();
+  }
+
+  for (size_t i = 0; i < levels.levels.size(); i++)
+    memcpy(dst + request.levels[i].offset, levels.levels[i].data.data(), levels.levels[i].data.size());
+}
+
+void TextureStreamer::update()
+{
+  bool bRetired = false;
+
+  // Fences signal in submission order.
+  while (!m_inFlight.empty())
+  {
+    GLenum status = glClientWaitSync(m_inFlight.front()->fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      break;
+
+    retire(*m_inFlight.front());
+    m_inFlight.pop_front();
+    bRetired = true;
+  }
+
+  std::deque<std::shared_ptr<Request>> staged;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    staged.swap(m_staged);
+  }
+
+  // Mip tails are small and always go up right away so new textures show this frame.
+  // Requests still waiting for ring space go back to the queue, the rest are started so
+  // they cannot hold on to the space the others wait for.
+  size_t uploadedBytes = 0;
+  std::deque<std::shared_ptr<Request>> deferred;
+  for (std::shared_ptr<Request>& request : staged)
+  {
+    if (!begin(*request, uploadedBytes))
+      deferred.push_back(std::move(request));
+    else if (!request->id)
+      continue;
+    else if (request->baseLevel > 0)
+      m_uploading.push_back(std::move(request));
+    else
+      finish(std::move(request));
+  }
+
+  if (!deferred.empty())
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_staged.insert(m_staged.begin(), deferred.begin(), deferred.end());
+  }
+
+  // Finer levels go round robin, one level per texture and pass, so everything sharpens
+  // together and the coarse levels land first.
+  bool bProgress = true;
+  while (bProgress && !m_uploading.empty())
+  {
+    bProgress = false;
+    for (auto it = m_uploading.begin(); it != m_uploading.end();)
+    {
+      Request& request = **it;
+
+      // The texture was destroyed and has deleted its id, keep the staged data until the
+      // uploads already issued have finished.
+      if (request.texture.use_count() == 1)
+      {
+        finish(std::move(*it));
+        it = m_uploading.erase(it);
+        continue;
+      }
+
+      size_t size = request.levels[request.baseLevel - 1].size;
+      if (uploadedBytes > 0 && uploadedBytes + size > m_uploadBudget)
+      {
+        ++it;
+        continue;
+      }
+
+      uploadedBytes += uploadLevels(request, request.baseLevel - 1, request.baseLevel - 1);
+      bProgress = true;
+
+      if (request.baseLevel == 0)
+      {
+        finish(std::move(*it));
+        it = m_uploading.erase(it);
+        continue;
+      }
+      ++it;
+    }
+  }
+
+  if (bRetired && numPending() == 0)
+  {
+    std::cout << "TextureStreamer: Uploaded " << m_numUploaded << " textures, "
+      << m_uploadedBytes / (1024 * 1024) << " MB.\n";
+  }
+}
+
+bool TextureStreamer::begin(Request& request, size_t& uploadedBytes)
+{
+  if (request.bFailed)
+  {
+    request.texture->bFailed = true;
+    return true;
+  }
+
+  // The texture was destroyed while decoding.
+  if (request.texture.use_count() == 1)
+  {
+    if (request.bInRing)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      freeRing(request.ringOffset);
+      request.bInRing = false;
+    }
+    return true;
+  }
+
+  // Textures larger than the whole ring upload from client memory.
+  if (!request.bInRing && m_ringData && request.size <= RING_SIZE)
+  {
+    size_t offset = 0;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!allocateRing(request.size, offset))
+        return false;
+    }
+
+    memcpy(m_ringData + offset, request.pixels.data(), request.size);
+    request.pixels = std::vector<uint8_t>();
+    request.bInRing = true;
+    request.ringOffset = offset;
+  }
+
+  const TextureCache::LevelEntry& base = request.levels[0];
+  request.id = Texture::createStorage(request.encoding, request.usage, (int)request.levels.size(), base.width, base.height);
+
+  // The coarsest level is always part of the tail.
+  int numLevels = (int)request.levels.size();
+  int first = numLevels - 1;
+  while (first > 0 && (int)std::max(request.levels[first - 1].width, request.levels[first - 1].height) <= MIP_TAIL_SIZE)
+    first--;
+
+  uploadedBytes += uploadLevels(request, first, numLevels - 1);
+
+  // Hand the id to the texture right away, it owns it from here on. Commands issued later
+  // see the uploaded levels without waiting for a fence.
+  request.texture->id = request.id;
+  m_numUploaded++;
+  return true;
+}
+
+size_t TextureStreamer::uploadLevels(Request& request, int first, int last)
+{
+  const uint8_t* pixels = nullptr;
+  if (request.bInRing)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ringBuffer);
+    pixels = (const uint8_t*)request.ringOffset;
+  }
+  else
+  {
+    pixels = request.pixels.data();
+  }
+
+  size_t bytes = 0;
+  for (int i = first; i <= last; i++)
+  {
+    const TextureCache::LevelEntry& level = request.levels[i];
+    Texture::uploadLevel(request.id, request.encoding, request.usage, i, level.width, level.height, level.size, pixels + level.offset);
+    bytes += level.size;
+  }
+
+  if (request.bInRing)
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  // Only sample the levels that are in.
+  request.baseLevel = first;
+  glTextureParameteri(request.id, GL_TEXTURE_BASE_LEVEL, first);
+  request.texture->bComplete = first == 0;
+
+  request.texture->residentBytes += bytes;
+  m_uploadedBytes += bytes;
+  return bytes;
+}
+
+void TextureStreamer::finish(std::shared_ptr<Request> request)
+{
+  request->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  m_inFlight.push_back(std::move(request));
+}
+
+void TextureStreamer::retire(Request& request)
+{
+  glDeleteSync(request.fence);
+  request.fence = nullptr;
+
+  if (request.bInRing)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    freeRing(request.ringOffset);
+    request.bInRing = false;
+  }
+  request.pixels = std::vector<uint8_t>();
+  request.id = 0;
+}
+
+void TextureStreamer::shutdown()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_decodeDone.wait(lock, [this] { return m_numDecoding == 0; });
+    m_staged.clear();
+  }
+
+  for (std::shared_ptr<Request>& request : m_uploading)
+    finish(std::move(request));
+  m_uploading.clear();
+
+  for (std::shared_ptr<Request>& request : m_inFlight)
+  {
+    glClientWaitSync(request->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    retire(*request);
+  }
+  m_inFlight.clear();
+
+  if (m_ringBuffer)
+  {
+    glUnmapNamedBuffer(m_ringBuffer);
+    glDeleteBuffers(1, &m_ringBuffer);
+    m_ringBuffer = 0;
+    m_ringData = nullptr;
+  }
+}
+
+size_t TextureStreamer::numPending()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_numDecoding + m_staged.size() + m_uploading.size() + m_inFlight.size();
+}
+
+bool TextureStreamer::allocateRing(size_t size, size_t& offset)
+{
+  size = (size + RING_ALIGNMENT - 1) & ~(RING_ALIGNMENT - 1);
+  if (m_allocations.empty())
+    m_ringHead = 0;
+
+  // Free space is [head, end) plus [0, tail) before the head wraps, [head, tail) after.
+  // The head never catches up with the tail while anything is allocated.
+  size_t tail = m_allocations.empty() ? 0 : m_allocations.front().offset;
+  if (m_allocations.empty() || m_ringHead > tail)
+  {
+    if (m_ringHead + size <= RING_SIZE)
+      offset = m_ringHead;
+    else if (size < tail)
+      offset = 0;
+    else
+      return false;
+  }
+  else
+  {
+    if (m_ringHead + size < tail)
+      offset = m_ringHead;
+    else
+      return false;
+  }
+
+  m_allocations.push_back({ offset, size, false });
+  m_ringHead = offset + size;
+  return true;
+}
+
+void TextureStreamer::freeRing(size_t offset)
+{
+  for (RingAllocation& allocation : m_allocations)
+  {
+    if (allocation.offset == offset && !allocation.bFreed)
+    {
+      allocation.bFreed = true;
+      break;
+    }
+  }
+
+  while (!m_allocations.empty() && m_allocations.front().bFreed)
+    m_allocations.pop_front();
+}
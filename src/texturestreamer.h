@@ -0,0 +1,132 @@
+#ifndef _TEXTURESTREAMER_H
+#define _TEXTURESTREAMER_H
+#include <glad/glad.h>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include "texture.h"
+#include "texturecache.h"
+
+// Streams textures in without stalling the GL thread. Mip chains come from the texture
+// cache, or are decoded, built and cached on the thread pool, and are staged into a
+// persistently mapped pixel unpack buffer. update() creates the full immutable chain and
+// uploads the mip tail first, so a texture is usable the frame it is staged; finer levels
+// follow over the next frames within a per-frame byte budget, with GL_TEXTURE_BASE_LEVEL
+// moving down as each level lands. The Texture handed out by load() binds a placeholder
+// until its mip tail is in.
+//
+// load(), update() and shutdown() must be called on the GL thread.
+class TextureStreamer
+{
+public:
+  static const size_t RING_SIZE = 64 * 1024 * 1024;
+  static const size_t RING_ALIGNMENT = 256;
+  static const size_t DEFAULT_UPLOAD_BUDGET = 4 * 1024 * 1024;
+
+  // Levels up to this size are uploaded together when a texture starts streaming.
+  static const int MIP_TAIL_SIZE = 64;
+
+protected:
+  struct Request
+  {
+    std::string path;
+    TextureUsage usage;
+    TextureCompression compression;
+    std::shared_ptr<StreamedTexture> texture;
+    bool bFailed;
+
+    // Level offsets are relative to the start of the staged data.
+    TextureEncoding encoding;
+    std::vector<TextureCache::LevelEntry> levels;
+
+    // Staged levels live in the ring at ringOffset, otherwise in pixels.
+    bool bInRing;
+    size_t ringOffset;
+    size_t size;
+    std::vector<uint8_t> pixels;
+
+    GLuint id;
+
+    // Finest level uploaded so far, levels.size() before the first upload.
+    int baseLevel;
+    GLsync fence;
+
+    inline Request() : usage(TextureUsage::Color), compression(TextureCompression::None), bFailed(false), encoding(TextureEncoding::RGBA8),
+      bInRing(false), ringOffset(0), size(0), id(0), baseLevel(0), fence(nullptr) { }
+  };
+
+  struct RingAllocation
+  {
+    size_t offset;
+    size_t size;
+    bool bFreed;
+  };
+
+  GLuint m_ringBuffer;
+  unsigned char* m_ringData;
+  bool m_bAllowBC1;
+
+  // Ring allocations in allocation order, guarded by m_mutex. Uploads retire in a different
+  // order than decodes finish, so freed allocations are only reclaimed once they reach the front.
+  std::deque<RingAllocation> m_allocations;
+  size_t m_ringHead;
+
+  std::mutex m_mutex;
+  std::condition_variable m_decodeDone;
+  std::deque<std::shared_ptr<Request>> m_staged;
+  size_t m_numDecoding;
+
+  // GL thread only. m_uploading still has levels to upload, m_inFlight waits for the
+  // fence of its last upload before releasing the staged data.
+  std::deque<std::shared_ptr<Request>> m_uploading;
+  std::deque<std::shared_ptr<Request>> m_inFlight;
+  size_t m_uploadBudget;
+  size_t m_numUploaded;
+  size_t m_uploadedBytes;
+
+public:
+  TextureStreamer();
+  ~TextureStreamer();
+
+  // delete copy constructor
+  TextureStreamer(const TextureStreamer&) = delete;
+  TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+  // Start streaming an image. The texture is usable right away and binds a placeholder
+  // until the upload has finished.
+  std::unique_ptr<Texture> load(const std::string& path, TextureUsage usage, TextureCompression compression = TextureCompression::None);
+
+  // Upload staged images and retire finished uploads. Call once per frame.
+  void update();
+
+  // Bytes of finer mip levels uploaded per update(). At least one level is uploaded each
+  // frame, so levels larger than the budget still land.
+  inline size_t getUploadBudget() const { return m_uploadBudget; }
+  inline void setUploadBudget(size_t bytes) { m_uploadBudget = bytes; }
+
+  // Wait for outstanding decodes and release all GL objects. Call before the context goes away.
+  void shutdown();
+
+  // Textures decoding, staged or uploading.
+  size_t numPending();
+
+  static TextureStreamer& global();
+
+protected:
+  void decode(std::shared_ptr<Request> request);
+  void stage(Request& request, const TextureLevels& levels);
+  // Create the texture and upload its mip tail, false while there is no ring space.
+  bool begin(Request& request, size_t& uploadedBytes);
+  size_t uploadLevels(Request& request, int first, int last);
+  void finish(std::shared_ptr<Request> request);
+  void retire(Request& request);
+
+  // Must hold m_mutex.
+  bool allocateRing(size_t size, size_t& offset);
+  void freeRing(size_t offset);
+};
+
+#endif // _TEXTURESTREAMER_H
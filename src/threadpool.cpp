@@ -0,0 +1,110 @@
+#include "threadpool.h"
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned numThreads)
+  : m_bStopping(false)
+{
+  if (numThreads == 0)
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  m_threads.reserve(numThreads);
+  for (unsigned i = 0; i < numThreads; i++)
+    m_threads.emplace_back(&ThreadPool::workerMain, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bStopping = true;
+  }
+  m_jobAvailable.notify_all();
+
+  for (std::thread& thread : m_threads)
+    thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(job));
+  }
+  m_jobAvailable.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+  if (count == 0)
+    return;
+
+  if (count == 1 || m_threads.size() <= 1)
+  {
+    for (size_t i = 0; i < count; i++)
+      fn(i);
+    return;
+  }
+
+  struct State
+  {
+    std::atomic<size_t> next{ 0 };
+    std::atomic<size_t> done{ 0 };
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  auto state = std::make_shared<State>();
+
+  // Helpers that start after every index is claimed exit without touching fn.
+  auto work = [state, count, &fn] {
+    for (;;)
+    {
+      size_t i = state->next.fetch_add(1);
+      if (i >= count)
+        return;
+
+      fn(i);
+
+      if (state->done.fetch_add(1) + 1 == count)
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->finished.notify_all();
+      }
+    }
+  };
+
+  size_t numHelpers = std::min(count - 1, m_threads.size());
+  for (size_t i = 0; i < numHelpers; i++)
+    submit(work);
+
+  work();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&] { return state->done.load() == count; });
+}
+
+ThreadPool& ThreadPool::global()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::workerMain()
+{
+  for (;;)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobAvailable.wait(lock, [this] { return m_bStopping || !m_jobs.empty(); });
+
+      if (m_jobs.empty())
+        return;
+
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+
+    job();
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+class ThreadPool
+{
+protected:
+  std::vector<std::thread> m_threads;
+  std::deque<std::function<void()>> m_jobs;
+  std::mutex m_mutex;
+  std::condition_variable m_jobAvailable;
+  bool m_bStopping;
+
+public:
+  ThreadPool(unsigned numThreads = 0);
+  ~ThreadPool();
+
+  // delete copy constructor
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> job);
+
+  // Run fn(0..count-1) across the pool and wait. The calling thread takes part, so this
+  // is safe to call from inside a pool job.
+  void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+  inline size_t numThreads() const { return m_threads.size(); }
+
+  // Shared pool used for load-time work.
+  static ThreadPool& global();
+
+protected:
+  void workerMain();
+};
+
+#endif // _THREADPOOL_H
@@ -0,0 +1,121 @@
+#ifndef _VERTEXDEDUPETABLE_H
+#define _VERTEXDEDUPETABLE_H
+#include <vector>
+#include <memory_resource>
+#include <cstdint>
+#include <cstddef>
+
+// OBJ position/normal/uv index triple.
+struct MeshIndexKey
+{
+  int posIdx;
+  int normalIdx;
+  int uvIdx;
+
+  bool operator==(const MeshIndexKey&) const = default;
+};
+
+// Flat open-addressing map from OBJ index triples to output vertex indices, used to
+// dedupe vertices while building parts. Linear probing over a power-of-two table,
+// sized up front from the face count so the hot loop never allocates. Storage comes from
+// the given memory resource, normally a load arena.
+class VertexDedupeTable
+{
+protected:
+  struct Slot
+  {
+    MeshIndexKey key;
+    int value; // -1 when empty.
+  };
+
+  std::pmr::vector<Slot> m_slots;
+  size_t m_mask;
+  size_t m_size;
+
+public:
+  VertexDedupeTable(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    : m_slots(resource), m_mask(0), m_size(0) { }
+
+  // Size the table for up to `numKeys` distinct keys.
+  void reserve(size_t numKeys)
+  {
+    size_t capacity = 16;
+    while (capacity * 7 < numKeys * 10)
+      capacity <<= 1;
+
+    if (capacity > m_slots.size())
+      rehash(capacity);
+  }
+
+  // Return the value stored for `key`, inserting `value` first if it is not present yet.
+  inline int findOrInsert(const MeshIndexKey& key, int value)
+  {
+    if ((m_size + 1) * 10 > m_slots.size() * 7)
+      rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+
+    size_t i = hash(key) & m_mask;
+    for (;;)
+    {
+      Slot& slot = m_slots[i];
+      if (slot.value < 0)
+      {
+        slot.key = key;
+        slot.value = value;
+        m_size++;
+        return value;
+      }
+
+      if (slot.key == key)
+        return slot.value;
+
+      i = (i + 1) & m_mask;
+    }
+  }
+
+  // Free the table storage.
+  void release()
+  {
+    std::pmr::vector<Slot>(m_slots.get_allocator()).swap(m_slots);
+    m_mask = 0;
+    m_size = 0;
+  }
+
+  inline size_t size() const { return m_size; }
+
+protected:
+  // Mix all 96 key bits (murmur3 finalizer) so nearby OBJ indices spread over the table.
+  static inline uint64_t mix(uint64_t h)
+  {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  static inline size_t hash(const MeshIndexKey& k)
+  {
+    uint64_t a = ((uint64_t)(uint32_t)k.posIdx << 32) | (uint32_t)k.normalIdx;
+    uint64_t b = (uint32_t)k.uvIdx;
+    return (size_t)mix(a ^ mix(b + 0x9e3779b97f4a7c15ull));
+  }
+
+  void rehash(size_t capacity)
+  {
+    std::pmr::vector<Slot> old(m_slots.get_allocator());
+    old.swap(m_slots);
+
+    m_slots.assign(capacity, Slot{ { 0, 0, 0 }, -1 });
+    m_mask = capacity - 1;
+    m_size = 0;
+
+    for (const Slot& slot : old)
+    {
+      if (slot.value >= 0)
+        findOrInsert(slot.key, slot.value);
+    }
+  }
+};
+
+#endif // _VERTEXDEDUPETABLE_H